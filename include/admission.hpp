@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// Adaptive concurrency limit for DB-bound work (AIMD on observed latency).
+// Completions under the target latency grow the limit by one per window
+// of `limit` successes; a slow or failed completion cuts it by `backoff`,
+// at most once per target interval so one slow burst isn't punished twice.
+class AdaptiveLimiter {
+public:
+  struct Options {
+    int initial = 4;
+    int min = 1;
+    int max = 6;
+    std::chrono::microseconds target{50000};
+    double backoff = 0.75;
+  };
+
+  explicit AdaptiveLimiter(const Options& opts);
+
+  bool try_acquire();
+  void release(std::chrono::microseconds latency, bool ok);
+
+  int limit() const { return limit_.load(std::memory_order_relaxed); }
+  int inflight() const { return inflight_.load(std::memory_order_relaxed); }
+  // Smoothed latency of recent completions
+  std::chrono::microseconds latency() const {
+    return std::chrono::microseconds(ewma_us_.load(std::memory_order_relaxed));
+  }
+
+private:
+  Options opts_;
+  std::atomic<int> limit_;
+  std::atomic<int> inflight_{0};
+  std::atomic<int64_t> ewma_us_{0};
+
+  std::mutex mu_;  // guards the AIMD bookkeeping below
+  int successes_ = 0;
+  std::chrono::steady_clock::time_point last_decrease_{};
+};
+
+// Admission in front of the handlers. Cache-servable reads never need a
+// permit; anything that touches the DB takes one from the adaptive limiter,
+// whose ceiling leaves some pool threads free so cache hits keep flowing
+// while the DB path is saturated.
+class AdmissionController {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options {
+    bool enabled = false;
+    AdaptiveLimiter::Options db;
+  };
+
+  // RAII permit for one DB-bound operation; records its latency on release
+  // (into the limiter when enabled, always into the db_ops/db_time totals).
+  class Permit {
+  public:
+    Permit() = default;
+    Permit(Permit&& o) noexcept { *this = std::move(o); }
+    Permit& operator=(Permit&& o) noexcept;
+    ~Permit() { release(); }
+
+    explicit operator bool() const { return granted_; }
+    void fail() { ok_ = false; }
+    void release();
+
+  private:
+    friend class AdmissionController;
+    AdmissionController* ac_ = nullptr;
+    bool limited_ = false;
+    Clock::time_point start_;
+    bool granted_ = false;
+    bool ok_ = true;
+  };
+
+  explicit AdmissionController(const Options& opts);
+
+  // Grants a DB permit unless the limiter is full or the request cannot
+  // finish before its deadline at the current DB latency.
+  Permit acquire_db(Clock::time_point deadline);
+
+  bool enabled() const { return opts_.enabled; }
+  const AdaptiveLimiter& db() const { return db_; }
+
+  uint64_t shed() const { return shed_.load(); }
+  uint64_t shed_deadline() const { return shed_deadline_.load(); }
+  uint64_t expired() const { return expired_.load(); }
+  void count_expired() { expired_++; }
+
+  // Completed DB-bound operations and the wall time they held a permit
+  uint64_t db_ops() const { return db_ops_.load(); }
+  uint64_t db_time_us() const { return db_time_us_.load(); }
+
+private:
+  Options opts_;
+  AdaptiveLimiter db_;
+  std::atomic<uint64_t> shed_{0}, shed_deadline_{0}, expired_{0};
+  std::atomic<uint64_t> db_ops_{0}, db_time_us_{0};
+};
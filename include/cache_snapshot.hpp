@@ -0,0 +1,75 @@
+#pragma once
+#include "db.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Cache persistence across restarts.
+//
+// write() copies every cache section (LRUCache shard or core partition) in
+// LRU order into a compact file, stamped with a DB clock watermark, and
+// renames it into place. restore() mmaps that file at startup and refills
+// the cache with several threads, one section at a time. Entries that fail
+// their checksum are dropped, and so are entries whose row was deleted or
+// written after the watermark: the DB is asked in batches which keys are
+// still unchanged.
+class CacheSnapshot {
+public:
+  using Entries = std::vector<std::pair<std::string, std::string>>;
+  // Copies one section, most recently used first.
+  using DumpFn = std::function<Entries(size_t section)>;
+  // Inserts validated entries (hottest first) behind anything already
+  // cached. Returns how many were inserted.
+  using RestoreFn = std::function<size_t(Entries&& entries)>;
+  // Optional counter bumped by every remote invalidation. A batch that
+  // raced one while being validated is dropped, like a read-miss fill.
+  using SeqFn = std::function<uint64_t()>;
+
+  struct Counters {
+    uint64_t writes, write_errors, last_write_entries, last_write_ms;
+    uint64_t restored, dropped_corrupt, dropped_stale, restore_ms;
+  };
+
+  CacheSnapshot(const DBConfig& dc, std::string path, size_t sections, DumpFn dump);
+  ~CacheSnapshot();
+
+  // Refills the cache from the snapshot file, if there is a usable one.
+  // Call before serving. Returns the number of entries restored.
+  size_t restore(int threads, const RestoreFn& restore, const SeqFn& seq = nullptr);
+
+  // Writes a snapshot now. Safe to call from any thread.
+  bool write();
+
+  // Also write every interval_s seconds from a background thread.
+  void start_periodic(int interval_s);
+
+  Counters counters() const;
+
+private:
+  void periodic_loop(int interval_s);
+
+  DBConfig dc_;
+  std::string path_;
+  size_t sections_;
+  DumpFn dump_;
+
+  std::mutex write_mu_;  // one writer at a time; guards write_db_
+  DB write_db_;
+  bool write_db_connected_ = false;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread periodic_;
+
+  std::atomic<uint64_t> writes_{0}, write_errors_{0};
+  std::atomic<uint64_t> last_write_entries_{0}, last_write_ms_{0};
+  std::atomic<uint64_t> restored_{0}, dropped_corrupt_{0}, dropped_stale_{0};
+  std::atomic<uint64_t> restore_ms_{0};
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Small built-in LZ77 block compressor (LZ4-style sequences: a token with
+// literal and match lengths, the literals, a 16-bit back offset). Fast
+// rather than tight; meant for keeping large cached values small, not for
+// storage or the wire.
+namespace compress {
+
+// Compresses len bytes into out (replacing its contents).
+void lz_compress(const char* data, size_t len, std::string& out);
+
+// Decompresses into out, which must come out exactly raw_len bytes long.
+// Returns false on malformed input.
+bool lz_decompress(const char* data, size_t len, size_t raw_len, std::string& out);
+
+// Cache representation of a value: one tag byte, then either the raw
+// bytes or a 4-byte raw length and the compressed block. Values shorter
+// than min_size (0 = never compress), or that don't shrink by at least
+// 1/8, are kept raw.
+std::string pack(const char* data, size_t len, size_t min_size);
+bool unpack(const std::string& packed, std::string& out);
+// Size of the value unpack() would produce, without decompressing.
+size_t unpacked_size(const std::string& packed);
+// Raw packed values hold the bytes as-is from RAW_OFFSET on, so they can
+// be served without unpacking.
+constexpr size_t RAW_OFFSET = 1;
+bool is_raw(const std::string& packed);
+
+} // namespace compress
@@ -0,0 +1,123 @@
+#pragma once
+#include "spsc_queue.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Shard-per-core cache. Each core thread exclusively owns one LRU partition,
+// so the partitions need no locks. Request threads forward operations to the
+// owning core over per-(producer, core) SPSC rings and wait for the reply.
+class CoreExecutor {
+public:
+  struct Options {
+    size_t capacity = 10000;
+    int cores = 4;
+    std::vector<int> cpus;     // optional pinning, one CPU per core thread
+    int max_producers = 64;    // request threads with their own SPSC rings
+    int idle_spins = 2000;     // empty polls before a core thread backs off
+  };
+
+  explicit CoreExecutor(const Options& opts);
+  ~CoreExecutor();
+
+  std::optional<std::string> get(const std::string& key);
+  // See LRUCache::put() for version
+  void put(const std::string& key, const std::string& value, uint64_t version = 0);
+  // See LRUCache::fill(); seq is checked on the owning core, in order with
+  // that core's erases
+  void fill(const std::string& key, const std::string& value, uint64_t version,
+            const std::atomic<uint64_t>& seq, uint64_t seen);
+  void erase(const std::string& key);
+  size_t size() const;
+  // Runs on every core in turn. Returns the number of entries removed.
+  size_t erase_if(const std::function<bool(const std::string&)>& pred);
+
+  using Entries = std::vector<std::pair<std::string, std::string>>;
+  // Copies one core's partition, most recently used first.
+  Entries snapshot(int core);
+  // Adds entries (hottest first) at the cold end of their partitions,
+  // skipping keys already cached and full partitions; see
+  // LRUCache::restore(). One message per core. Returns the number added.
+  size_t restore(const Entries& entries);
+
+  int cores() const { return static_cast<int>(cores_.size()); }
+  uint64_t overflow_ops() const { return overflow_ops_.load(); }
+
+private:
+  enum class Op : uint8_t { Get, Put, Erase, EraseIf, Snapshot, Restore };
+
+  // Lives on the requesting thread's stack until done is set.
+  struct Request {
+    Op op;
+    const std::string* key;
+    const std::string* value;
+    std::optional<std::string> result;
+    uint64_t version = 0;
+    const std::atomic<uint64_t>* seq = nullptr;  // Put: fill guard, see fill()
+    uint64_t seen = 0;
+    const std::function<bool(const std::string&)>* pred = nullptr;
+    size_t removed = 0;        // EraseIf; entries added for Restore
+    Entries* entries = nullptr;  // Snapshot output, Restore input
+    std::atomic<bool> done{false};
+  };
+
+  // Plain LRU, touched only by its owning core thread.
+  class Partition {
+  public:
+    explicit Partition(size_t cap) : cap_(cap) {}
+    std::optional<std::string> get(const std::string& key);
+    void put(const std::string& key, const std::string& value, uint64_t version);
+    void erase(const std::string& key);
+    size_t erase_if(const std::function<bool(const std::string&)>& pred);
+    void snapshot(Entries& out) const;
+    size_t restore(const Entries& entries);
+    size_t size() const { return map_.size(); }
+
+  private:
+    using ListIt = std::list<std::string>::iterator;
+    std::list<std::string> list_;
+    struct Slot {
+      std::string value;
+      ListIt pos;
+      uint64_t version;  // DB row version, 0 = unknown
+    };
+    std::unordered_map<std::string, Slot> map_;
+    size_t cap_;
+  };
+
+  struct Core {
+    explicit Core(size_t cap, int producers);
+
+    Partition part;
+    std::vector<std::unique_ptr<SpscQueue<Request*>>> rings;  // one per producer
+    // Fallback for request threads beyond max_producers
+    std::mutex overflow_mu;
+    std::vector<Request*> overflow;
+    std::atomic<bool> has_overflow{false};
+    alignas(64) std::atomic<size_t> size{0};
+    std::thread thread;
+  };
+
+  void run(Core& core, int cpu);
+  void execute(Core& core, Request* req);
+  void submit(Request& req);
+  // bulk: snapshot/restore traffic from short-lived threads; goes through
+  // the overflow queue so it never claims one of the producer rings
+  void submit(Request& req, Core& core, bool bulk = false);
+  int producer_id();
+
+  Options opts_;
+  std::vector<std::unique_ptr<Core>> cores_;
+  std::atomic<int> next_producer_{0};
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> overflow_ops_{0};
+};
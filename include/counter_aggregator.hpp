@@ -0,0 +1,70 @@
+#pragma once
+#include "db.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Write-behind increments for hot counters. add() only folds the delta
+// into an in-memory sum; a flusher thread applies all pending sums every
+// flush_ms with a single batched UPDATE ... RETURNING and hands the new
+// rows to apply (which updates the cache). A thousand increments of one
+// key between flushes cost one row write.
+//
+// Deferred increments are not durable until flushed: they are lost if
+// the process dies, and reads see them only after the next flush. A
+// failed flush is retried with the deltas merged back.
+class CounterAggregator {
+public:
+  using ApplyFn = std::function<void(const std::string& key, const DB::Row& row)>;
+
+  struct Counters {
+    uint64_t deferred, flushes, flushed_keys, flush_errors, dropped;
+  };
+
+  CounterAggregator(const DBConfig& dc, int flush_ms, ApplyFn apply);
+  // Flushes what is pending, retrying for up to a second; anything still
+  // unwritten is logged and counted as dropped
+  ~CounterAggregator();
+
+  void add(const std::string& key, int64_t delta);
+
+  // Applies everything pending now; returns false if the DB write failed.
+  bool flush();
+
+  Counters counters() const;
+
+private:
+  static constexpr size_t NUM_SHARDS = 16;
+  static constexpr int FINAL_FLUSH_TRIES = 5;
+
+  struct Shard {
+    std::mutex mu;
+    std::unordered_map<std::string, int64_t> pending;
+  };
+
+  void run();
+  size_t pending_keys();
+
+  DBConfig dc_;
+  int flush_ms_;
+  ApplyFn apply_;
+  std::array<Shard, NUM_SHARDS> shards_;
+
+  std::mutex flush_mu_;  // one flush at a time; guards db_
+  DB db_;
+  bool connected_ = false;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread flusher_;
+
+  std::atomic<uint64_t> deferred_{0}, flushes_{0}, flushed_keys_{0};
+  std::atomic<uint64_t> flush_errors_{0}, dropped_{0};
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
 #include <optional>
+#include <cstdint>
+#include <utility>
+#include <vector>
 #include <libpq-fe.h> 
 
 struct DBConfig {
@@ -16,11 +19,64 @@ public:
   DB() = default;
   ~DB();
 
+  // libpq connection string used by connect(); shared with components
+  // that need a raw PGconn of their own (e.g. LISTEN connections).
+  static std::string conninfo(const DBConfig& cfg);
+
+  // Every write gives the row a new version from a sequence shared by all
+  // keys, so versions only increase, even across delete and re-create;
+  // when non-null, version receives the version written or read.
   bool connect(const DBConfig& cfg);
-  bool upsert(const std::string& key, const std::string& value);
-  std::optional<std::string> get(const std::string& key);
+  // False once the server has closed or broken the connection.
+  bool connection_ok() const;
+  bool upsert(const std::string& key, const std::string& value, uint64_t* version = nullptr);
+  // nullopt both when the key is missing and on error; error, when
+  // non-null, tells the two apart.
+  std::optional<std::string> get(const std::string& key, uint64_t* version = nullptr,
+                                 bool* error = nullptr);
   bool erase(const std::string& key);
 
+  // ---- Binary values ----
+  // Stored in kv_blob as bytea and sent over the wire in libpq's binary
+  // format, so bytes are never hex-escaped or NUL-terminated.
+  bool put_blob(const std::string& key, const char* data, size_t len,
+                uint64_t* version = nullptr);
+  std::optional<std::string> get_blob(const std::string& key, uint64_t* version = nullptr);
+  bool erase_blob(const std::string& key);
+
+  // ---- Atomic single-statement operations ----
+  struct Row {
+    std::string value;
+    uint64_t version = 0;
+  };
+  enum class OpStatus { Ok, Conflict, NotFound, NotInteger, Error };
+  struct OpResult {
+    OpStatus status = OpStatus::Error;
+    Row row;  // the row as written; the current row on Conflict, if known
+  };
+
+  // value += delta; a missing key counts as 0.
+  OpResult incr(const std::string& key, int64_t delta);
+  // value += suffix; a missing key counts as "".
+  OpResult append(const std::string& key, const std::string& suffix);
+  // Writes value only if the row's version is expected (0 = key must not
+  // exist yet).
+  OpResult cas(const std::string& key, const std::string& value, uint64_t expected);
+  // Applies many increments in one statement. On success out holds the new
+  // row of every key; fails as a whole if any stored value isn't an integer.
+  // Rows are locked in the order given, so concurrent callers should sort
+  // by key to avoid deadlocks.
+  OpStatus incr_many(const std::vector<std::pair<std::string, int64_t>>& deltas,
+                     std::vector<std::pair<std::string, Row>>& out);
+
+  // DB clock in microseconds since the unix epoch; every write stamps
+  // updated_at from the same clock. nullopt on error.
+  std::optional<int64_t> now_us();
+  // The subset of keys that exist and were last written before before_us,
+  // i.e. whose cached copies from that time are still current.
+  std::optional<std::vector<std::string>> unchanged_before(
+    const std::vector<std::string>& keys, int64_t before_us);
+
 private:
   PGconn* conn_ = nullptr;
 };
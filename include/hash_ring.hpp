@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ClusterNode {
+  std::string id;
+  std::string host;
+  int port = 0;
+};
+
+// Static cluster membership, read from a file with one node per line:
+//
+//   # comment
+//   vnodes 128
+//   n1 127.0.0.1:8081
+//   n2 127.0.0.1:8082
+//
+// The same file is shared by every kvserver and by loadgen, so they all
+// build identical rings.
+struct ClusterMembership {
+  std::vector<ClusterNode> nodes;
+  int vnodes = 128;
+};
+
+bool load_membership(const std::string& path, ClusterMembership& out, std::string& err);
+
+// Consistent-hash ring with virtual nodes. Adding or removing a node only
+// moves the keys on the arcs that node gains or loses.
+class HashRing {
+public:
+  explicit HashRing(const ClusterMembership& m);
+
+  const ClusterNode& owner(const std::string& key) const;
+  size_t owner_index(const std::string& key) const;
+  const std::vector<ClusterNode>& nodes() const { return nodes_; }
+  int vnodes() const { return vnodes_; }
+  const ClusterNode* find(const std::string& id) const;
+
+  // Stable across processes and builds (unlike std::hash)
+  static uint64_t hash(const std::string& s);
+
+private:
+  struct Point {
+    uint64_t hash;
+    uint32_t node;
+    bool operator<(const Point& o) const { return hash < o.hash; }
+  };
+
+  std::vector<ClusterNode> nodes_;
+  std::vector<Point> points_;
+  int vnodes_;
+};
@@ -1,26 +1,145 @@
 #pragma once
+#include "admission.hpp"
+#include "cache_snapshot.hpp"
 #include "db.hpp"
 #include "lru_cache.hpp"
+#include "core_executor.hpp"
+#include "counter_aggregator.hpp"
+#include "hash_ring.hpp"
+#include "invalidation_bus.hpp"
+#include "cpp-httplib/httplib.h"
+#include "refresher.hpp"
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
+#include <vector>
 
 struct ServerConfig {
   std::string host = "0.0.0.0";
   int port = 8080;
   size_t cache_capacity = 10000;
   int threads = std::thread::hardware_concurrency();
+
+  // Cache entry ageing (milliseconds, 0 = disabled); see CachePolicy
+  int cache_ttl_ms = 0;
+  int refresh_after_ms = 0;
+  int stale_window_ms = 0;
+  int refresh_min_hits = 2;
+  int refresh_workers = 2;
+
+  // Per-thread near-cache for hot keys (slots per thread, 0 = disabled)
+  int near_cache_slots = 256;
+  int near_cache_sample = 8;     // count 1 in N lookups
+  int near_cache_threshold = 4;  // sampled hits before a key counts as hot
+
+  // Shard-per-core mode: cache partitions owned by pinned core threads
+  // instead of mutex-protected shards (0 = disabled)
+  int shard_cores = 0;
+  std::vector<int> core_cpus;    // optional CPU per core thread
+  int core_max_producers = 64;
+
+  // Cluster mode: this node's id in a static membership file
+  std::string cluster_file;
+  std::string cluster_self;
+  bool cluster_redirect = false;  // 307 to the owner instead of forwarding
+
+  // Cross-instance invalidation via LISTEN/NOTIFY (empty channel = disabled)
+  std::string inval_channel;
+  int inval_batch_ms = 5;
+
+  // Admission control for DB-bound work (0 target = disabled). The DB
+  // limit stays below the pool size so cache hits always find a thread.
+  int admit_db_target_ms = 0;
+  int admit_db_max = CPPHTTPLIB_THREAD_POOL_COUNT - 2;
+  int admit_max_queue = 0;       // queued connections before new ones are refused
+  int retry_after_s = 1;
+
+  // Cache snapshot written on shutdown and every interval (empty path =
+  // disabled, 0 interval = shutdown only), restored at startup
+  std::string snapshot_path;
+  int snapshot_interval_s = 0;
+  int snapshot_load_threads = 0;  // 0 = one per CPU
+
+  // Write-behind for increments sent with "defer":true, flushed every
+  // N ms (0 = disabled, such increments run synchronously)
+  int counter_flush_ms = 0;
+
+  // Binary values (/blob): own LRU of up to blob_cache_cap entries,
+  // values above blob_cache_max_value bytes are not cached, values from
+  // blob_compress_min bytes on are cached compressed (0 = never)
+  size_t blob_cache_cap = 1024;
+  size_t blob_cache_max_value = 1 << 20;
+  size_t blob_compress_min = 0;
+  size_t blob_max_bytes = 64 << 20;  // larger uploads get 413
 };
 
 class KVServer {
 public:
   KVServer(const ServerConfig& sc, const DBConfig& dc);
   bool start();  // blocking call to run the HTTP server
+  // Makes start() return, after which it writes the final snapshot.
+  // Safe to call from any thread, e.g. a signal-waiting one.
+  void stop();
 
 private:
+  // Cache access shared by all handlers; routes to the core executor in
+  // shard-per-core mode, otherwise to the near-cache and LRUCache.
+  std::optional<std::string> cache_get(const std::string& key);
+  void cache_put(const std::string& key, const std::string& value, uint64_t version = 0);
+  // Caches a DB read that started at invalidation sequence seen, unless an
+  // invalidation has arrived since (checked atomically with the insert)
+  void cache_fill(const std::string& key, const std::string& value, uint64_t version,
+                  uint64_t seen);
+  void cache_erase(const std::string& key);
+  size_t cache_size() const;
+
+  // Blob cache entries are compress::pack()ed into shared buffers, so a
+  // hit hands out the buffer itself; see ServerConfig. With seen set,
+  // behaves like cache_fill().
+  void blob_cache_put(const std::string& key, const std::string& value, uint64_t version,
+                      std::optional<uint64_t> seen = std::nullopt);
+
+  // Cluster mode: answers for keys owned by another node, either by
+  // forwarding the request (one hop) or redirecting. Returns false when
+  // this node should serve the key itself. body overrides req.body for
+  // handlers that read the body themselves.
+  bool route_remote(const std::string& key, const httplib::Request& req,
+                    httplib::Response& res, const std::string* body = nullptr);
+  bool reload_ring(std::string& err);
+
+  // Absolute deadline from the client's X-Deadline-Ms header (unix ms),
+  // or time_point::max() when absent.
+  static AdmissionController::Clock::time_point deadline_of(const httplib::Request& req);
+
   ServerConfig sc_;
+  DBConfig dc_;
   DB db_;
   std::unique_ptr<LRUCache> cache_;
+  using BlobCache = BasicLRUCache<std::shared_ptr<const std::string>>;
+  std::unique_ptr<BlobCache> blob_cache_;
+  std::unique_ptr<CoreExecutor> cores_;
+  std::unique_ptr<Refresher> refresher_;  // declared after cache_ so it stops first
+  std::unique_ptr<InvalidationBus> bus_;
+  std::unique_ptr<CacheSnapshot> snapshot_;
+  std::unique_ptr<CounterAggregator> counters_;  // after cache_/bus_: flushes into them
+  std::unique_ptr<AdmissionController> admission_;
+  std::shared_ptr<const HashRing> ring_;  // swapped atomically on reload
+  std::mutex ring_reload_mu_;
   std::atomic<uint64_t> hits_{0}, misses_{0};
+  std::atomic<uint64_t> near_hits_{0};
+  std::atomic<uint64_t> forwarded_{0}, redirected_{0}, forward_errors_{0};
+  std::atomic<uint64_t> atomic_ops_{0}, cas_conflicts_{0};
+  std::atomic<uint64_t> blob_hits_{0}, blob_misses_{0};
+  std::atomic<uint64_t> blob_cached_bytes_{0}, blob_packed_bytes_{0};  // cumulative puts
+  // Bumped by every remote invalidation; a read-miss fill that raced one
+  // is served but not cached.
+  std::atomic<uint64_t> inval_seq_{0};
+
+  httplib::Server srv_;
+  std::chrono::steady_clock::time_point created_at_ = std::chrono::steady_clock::now();
+  std::atomic<uint64_t> startup_ms_{0};  // construction until listening
 };
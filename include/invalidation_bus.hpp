@@ -0,0 +1,76 @@
+#pragma once
+#include "db.hpp"
+#include <libpq-fe.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Cross-instance cache invalidation over Postgres LISTEN/NOTIFY.
+//
+// Writers publish() the keys they change; a publisher thread batches them
+// into pg_notify() calls every batch_ms. A dedicated LISTEN connection
+// applies invalidations from other instances to the local cache. If that
+// connection drops, notifications sent meanwhile are lost, so the whole
+// local cache is flushed after reconnecting.
+class InvalidationBus {
+public:
+  using ApplyFn = std::function<void(const std::string& key)>;
+  using FlushFn = std::function<void()>;
+
+  struct Counters {
+    uint64_t published_keys, published_batches, publish_errors;
+    uint64_t received_batches, applied_keys;
+    uint64_t lag_ms_last, lag_ms_max, lag_ms_sum;
+    uint64_t reconnects, full_flushes;
+  };
+
+  InvalidationBus(const DBConfig& dc, const std::string& channel, int batch_ms,
+                  ApplyFn apply, FlushFn flush);
+  ~InvalidationBus();
+
+  // Queues a key for the next batch. Cheap; never touches the DB.
+  void publish(const std::string& key);
+
+  // Waits until the listener's first LISTEN has succeeded and the flush
+  // that follows it has run. False if that didn't happen within timeout.
+  bool wait_listening(std::chrono::milliseconds timeout);
+
+  Counters counters() const;
+
+private:
+  void publisher_loop();
+  void listener_loop();
+  bool send(PGconn* conn, const std::string& payload);
+  void handle(const std::string& payload);
+  PGconn* connect_listener();
+
+  DBConfig dc_;
+  std::string channel_;
+  std::string origin_;  // unique per process; our own batches are skipped
+  int batch_ms_;
+  ApplyFn apply_;
+  FlushFn flush_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<std::string> pending_;
+  bool flush_all_pending_ = false;  // set when pending_ overflowed
+  uint64_t pending_since_ms_ = 0;   // unix ms the oldest pending key was queued
+  bool listening_ = false;
+  std::condition_variable listening_cv_;
+  std::atomic<bool> stop_{false};
+
+  std::thread publisher_;
+  std::thread listener_;
+
+  std::atomic<uint64_t> published_keys_{0}, published_batches_{0}, publish_errors_{0};
+  std::atomic<uint64_t> received_batches_{0}, applied_keys_{0};
+  std::atomic<uint64_t> lag_ms_last_{0}, lag_ms_max_{0}, lag_ms_sum_{0};
+  std::atomic<uint64_t> reconnects_{0}, full_flushes_{0};
+};
@@ -0,0 +1,246 @@
+#pragma once
+#include "hash_ring.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// Configuration
+// ============================================================================
+struct LoadGenConfig {
+  std::string server_host = "127.0.0.1";
+  int server_port = 8080;
+  int num_threads = 10;
+  int duration_seconds = 60;
+  std::string workload_type = "get_popular"; // get_all, put_all, get_popular, get_put
+  int popular_keys = 100; // for get_popular workload
+  double read_ratio = 0.8; // for get_put workload (80% reads, 20% writes)
+  std::string ring_file; // cluster membership file: route each key to its owner
+  int deadline_ms = 0;   // sent as X-Deadline-Ms; 0 = no deadline
+  std::string engine = "blocking"; // blocking (1 connection/thread) or epoll
+  int conns_per_thread = 100;      // epoll engine only
+  int pipeline_depth = 1;          // epoll engine: requests in flight per connection
+  double target_rps = 0;           // total send rate over all threads; 0 = closed loop
+  bool verbose = true;             // per-thread start/stop lines
+};
+
+// ============================================================================
+// Statistics tracking
+// ============================================================================
+struct Stats {
+  std::atomic<uint64_t> total_requests{0};
+  std::atomic<uint64_t> successful_requests{0};
+  std::atomic<uint64_t> failed_requests{0};
+  std::atomic<uint64_t> shed_requests{0};  // 503/504 from admission control
+  std::atomic<uint64_t> total_response_time_us{0};
+  
+  // Log-linear latency histogram of successful requests: 1 us buckets
+  // below 64 us, then 32 buckets per power of two (about 3% resolution)
+  static constexpr int LATENCY_BUCKETS = 64 + 26 * 32;
+  std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> latency_buckets{};
+  
+  static int latency_bucket(uint64_t us) {
+    if (us < 64) return static_cast<int>(us);
+    int e = 63 - __builtin_clzll(us);
+    int b = 64 + (e - 6) * 32 + static_cast<int>((us >> (e - 5)) & 31);
+    return std::min(b, LATENCY_BUCKETS - 1);
+  }
+  
+  // Midpoint of a bucket, in microseconds
+  static double latency_bucket_us(int b) {
+    if (b < 64) return b;
+    int e = 6 + (b - 64) / 32;
+    uint64_t width = uint64_t{1} << (e - 5);
+    return static_cast<double>((uint64_t{1} << e) + ((b - 64) % 32) * width) + width / 2.0;
+  }
+  
+  // Latency at quantile q (0..1) of successful requests; 0 when there are none
+  double percentile_us(double q) const {
+    uint64_t n = 0;
+    for (const auto& b : latency_buckets) n += b.load(std::memory_order_relaxed);
+    if (n == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * n + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+      seen += latency_buckets[i].load(std::memory_order_relaxed);
+      if (seen >= rank) return latency_bucket_us(i);
+    }
+    return latency_bucket_us(LATENCY_BUCKETS - 1);
+  }
+  
+  // Starts a new measurement window; racing recorders land in either one
+  void reset() {
+    total_requests = 0;
+    successful_requests = 0;
+    failed_requests = 0;
+    shed_requests = 0;
+    total_response_time_us = 0;
+    for (auto& b : latency_buckets) b.store(0, std::memory_order_relaxed);
+  }
+  
+  void record_success(uint64_t response_time_us) {
+    total_requests++;
+    successful_requests++;
+    total_response_time_us += response_time_us;
+    latency_buckets[latency_bucket(response_time_us)].fetch_add(1, std::memory_order_relaxed);
+  }
+  
+  void record_failure() {
+    total_requests++;
+    failed_requests++;
+  }
+  
+  void record_shed() {
+    total_requests++;
+    shed_requests++;
+  }
+  
+  // Classifies a completed HTTP exchange
+  void record_status(int status, bool accept_404, uint64_t response_time_us) {
+    if (status == 200 || (accept_404 && status == 404)) {
+      record_success(response_time_us);
+    } else if (status == 503 || status == 504) {
+      record_shed();
+    } else {
+      record_failure();
+    }
+  }
+  
+  void print_summary(int duration_seconds) {
+    uint64_t total = total_requests.load();
+    uint64_t success = successful_requests.load();
+    uint64_t failed = failed_requests.load();
+    uint64_t shed = shed_requests.load();
+    uint64_t total_time = total_response_time_us.load();
+    
+    double throughput = static_cast<double>(success) / duration_seconds;
+    double avg_response_time_ms = success > 0 ? 
+      static_cast<double>(total_time) / success / 1000.0 : 0.0;
+    
+    std::cout << "\n========================================\n";
+    std::cout << "LOAD TEST RESULTS\n";
+    std::cout << "========================================\n";
+    std::cout << "Duration:              " << duration_seconds << " seconds\n";
+    std::cout << "Total requests:        " << total << "\n";
+    std::cout << "Successful requests:   " << success << "\n";
+    std::cout << "Failed requests:       " << failed << "\n";
+    std::cout << "Shed requests:         " << shed << "\n";
+    std::cout << "Success rate:          " << std::fixed << std::setprecision(2) 
+              << (total > 0 ? (success * 100.0 / total) : 0.0) << "%\n";
+    std::cout << "========================================\n";
+    std::cout << "Average Throughput:    " << std::fixed << std::setprecision(2) 
+              << throughput << " req/s\n";
+    std::cout << "Average Response Time: " << std::fixed << std::setprecision(2) 
+              << avg_response_time_ms << " ms\n";
+    std::cout << "P50 / P99 Response:    " << std::fixed << std::setprecision(2)
+              << percentile_us(0.50) / 1000.0 << " / " << percentile_us(0.99) / 1000.0 << " ms\n";
+    std::cout << "========================================\n";
+  }
+};
+
+// ============================================================================
+// Requests
+// ============================================================================
+// A workload describes what to send; the worker decides where it goes
+// (single server or the owning cluster node) and records the outcome.
+struct KVRequest {
+  enum class Method { Get, Post, Delete };
+  Method method = Method::Get;
+  std::string key;       // routing key
+  std::string path;
+  std::string body;      // POST only
+  bool accept_404 = false;
+};
+
+// ============================================================================
+// Workload generators
+// ============================================================================
+class WorkloadGenerator {
+public:
+  virtual ~WorkloadGenerator() = default;
+  virtual KVRequest next(int thread_id) = 0;
+};
+
+// nullptr for an unknown config.workload_type
+std::unique_ptr<WorkloadGenerator> make_workload(const LoadGenConfig& config);
+
+// Creates the keys a read workload expects to find
+void warmup(const LoadGenConfig& config);
+
+// ============================================================================
+// Pacing
+// ============================================================================
+// Open-loop send schedule for one worker thread at its share of
+// LoadGenConfig::target_rps. A thread that falls behind sends at once and
+// catches up at most one second of missed slots, so an overloaded server
+// shows up as achieved < target instead of as an unbounded burst.
+class Pacer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Pacer(double rps)
+      : interval_(rps > 0 ? std::chrono::nanoseconds(static_cast<int64_t>(1e9 / rps))
+                          : std::chrono::nanoseconds::zero()),
+        next_(Clock::now()) {}
+
+  bool enabled() const { return interval_.count() > 0; }
+  Clock::time_point due() const { return next_; }
+  bool ready(Clock::time_point now) const { return !enabled() || now >= next_; }
+
+  void sent(Clock::time_point now) {
+    if (!enabled()) return;
+    next_ = std::max(next_, now - std::chrono::seconds(1)) + interval_;
+  }
+
+  // Blocking engines: sleeps until the next slot and claims it
+  void wait() {
+    if (!enabled()) return;
+    std::this_thread::sleep_until(next_);
+    sent(Clock::now());
+  }
+
+private:
+  std::chrono::nanoseconds interval_;
+  Clock::time_point next_;
+};
+
+// ============================================================================
+// Engines
+// ============================================================================
+// Event-driven engine: one epoll loop per thread driving many nonblocking
+// keep-alive connections (see loadgen_epoll.cpp).
+void epoll_worker_thread(int thread_id, const LoadGenConfig& config, const HashRing* ring,
+                         WorkloadGenerator* workload, Stats& stats,
+                         std::atomic<bool>& should_stop);
+
+// config.num_threads workers of config.engine, sending until stop() (or
+// destruction). config must outlive the run.
+class LoadRun {
+public:
+  LoadRun(const LoadGenConfig& config, const HashRing* ring, WorkloadGenerator* workload,
+          Stats& stats);
+  ~LoadRun() { stop(); }
+
+  void stop();
+
+private:
+  std::atomic<bool> should_stop_{false};
+  std::vector<std::thread> threads_;
+};
+
+// ============================================================================
+// Sweeps
+// ============================================================================
+// Steps through the thread counts or target rates and workloads in a sweep
+// file, measuring each step against kvserver's /metrics, and writes one JSON
+// results file (see loadgen_sweep.cpp). base supplies everything the file
+// doesn't set. Returns the process exit code.
+int run_sweep(const std::string& path, const LoadGenConfig& base, const HashRing* ring);
@@ -1,16 +1,54 @@
 #pragma once
+#include <algorithm>
 #include <unordered_map>
 #include <list>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
-class LRUCache {
+// Age-based behaviour of cached entries. All durations are measured from the
+// moment the value was loaded (put or refreshed). Zero disables the feature.
+struct CachePolicy {
+  // Entries older than this are expired and treated as misses.
+  std::chrono::milliseconds ttl{0};
+  // Hot entries older than this are reloaded in the background while
+  // readers keep getting the current value.
+  std::chrono::milliseconds refresh_after{0};
+  // Past ttl, an entry may still be served for this long while a reload
+  // is in flight. Only used when a refresh hook is installed.
+  std::chrono::milliseconds stale_window{0};
+  // Reads since the last load needed before an entry counts as hot.
+  uint32_t refresh_min_hits = 2;
+};
+
+// Sharded LRU of values of type V, keyed by string. LRUCache holds plain
+// strings; the blob cache holds shared buffers so hits can hand them out
+// without copying under the shard lock.
+template <typename V>
+class BasicLRUCache {
 public:
-  explicit LRUCache(size_t capacity) : cap_(capacity) {
+  using Clock = std::chrono::steady_clock;
+  // Called (outside any shard lock) when an entry should be reloaded.
+  // The generation must be passed back to finish_refresh().
+  using RefreshHook = std::function<void(const std::string& key, uint64_t gen)>;
+
+  // What a near-cache needs to validate a copy of a value later: the copy is
+  // current while its shard's epoch is unchanged and expires_at is ahead.
+  struct ReadStamp {
+    size_t shard = 0;
+    uint64_t epoch = 0;
+    Clock::time_point expires_at = Clock::time_point::max();
+  };
+
+  explicit BasicLRUCache(size_t capacity) : cap_(capacity) {
     // Initialize all shards with reserved space
     size_t shard_capacity = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
     shards_.reserve(NUM_SHARDS);
@@ -19,49 +57,178 @@ public:
     }
   }
 
-  std::optional<std::string> get(const std::string& key) {
+  // Must be called before the cache is shared between threads.
+  void set_policy(const CachePolicy& policy, RefreshHook hook = nullptr) {
+    policy_ = policy;
+    refresh_hook_ = std::move(hook);
+    timed_ = policy_.ttl.count() > 0 || policy_.refresh_after.count() > 0;
+  }
+
+  std::optional<V> get(const std::string& key, ReadStamp* stamp = nullptr) {
+    size_t idx = shard_index(key);
+    auto& shard = *shards_[idx];
+    uint64_t refresh_gen = 0;
+    std::optional<V> out;
+    {
+      std::lock_guard<std::mutex> g(shard.mu);
+
+      auto it = shard.map.find(key);
+      if (it == shard.map.end()) return std::nullopt;
+
+      if (timed_) {
+        Entry& e = it->second;
+        auto age = Clock::now() - e.loaded_at;
+        bool past_ttl = policy_.ttl.count() > 0 && age >= policy_.ttl;
+        if (past_ttl && (!refresh_hook_ || age >= policy_.ttl + policy_.stale_window)) {
+          shard.list.erase(e.pos);
+          shard.map.erase(it);
+          expired_++;
+          return std::nullopt;
+        }
+
+        e.hits++;
+        bool hot = policy_.refresh_after.count() > 0 &&
+                   age >= policy_.refresh_after &&
+                   e.hits >= policy_.refresh_min_hits;
+        if (refresh_hook_ && !e.refreshing && (past_ttl || hot)) {
+          e.refreshing = true;
+          refresh_gen = e.gen;
+        }
+        if (past_ttl) stale_hits_++;
+      }
+
+      touch(shard, it);
+      out = it->second.value;
+      if (stamp) {
+        stamp->shard = idx;
+        stamp->epoch = shard.epoch.load(std::memory_order_relaxed);
+        if (policy_.ttl.count() > 0) stamp->expires_at = it->second.loaded_at + policy_.ttl;
+      }
+    }
+
+    if (refresh_gen != 0) {
+      refreshes_++;
+      refresh_hook_(key, refresh_gen);
+    }
+    return out;
+  }
+
+  // version is the DB row version the value came from (0 = unknown). A
+  // put older than the cached entry is ignored, so concurrent writers
+  // finishing out of order can't leave an older row cached.
+  void put(const std::string& key, const V& value, uint64_t version = 0) {
     auto& shard = *get_shard(key);
     std::lock_guard<std::mutex> g(shard.mu);
-    
+    put_locked(shard, key, value, version);
+  }
+
+  // put() for a value read from the DB while seq read seen: dropped if an
+  // invalidation has bumped seq since. The check holds the shard lock and
+  // invalidations bump seq before erasing, so a value read before an
+  // invalidation can never be inserted after its erase.
+  void fill(const std::string& key, const V& value, uint64_t version,
+            const std::atomic<uint64_t>& seq, uint64_t seen) {
+    auto& shard = *get_shard(key);
+    std::lock_guard<std::mutex> g(shard.mu);
+    if (seq.load() != seen) return;
+    put_locked(shard, key, value, version);
+  }
+
+  void erase(const std::string& key) {
+    auto& shard = *get_shard(key);
+    std::lock_guard<std::mutex> g(shard.mu);
+
+    // Bump even on a miss: a near-cache may still hold a copy of an
+    // entry this shard has since evicted.
+    bump_epoch(shard);
     auto it = shard.map.find(key);
-    if (it == shard.map.end()) return std::nullopt;
-    
-    touch(shard, it);
-    return it->second.first;
+    if (it == shard.map.end()) return;
+
+    shard.list.erase(it->second.pos);
+    shard.map.erase(it);
   }
 
-  void put(const std::string& key, const std::string& value) {
+  // Drops every entry whose key matches pred. Returns the number removed.
+  size_t erase_if(const std::function<bool(const std::string&)>& pred) {
+    size_t removed = 0;
+    for (auto& sp : shards_) {
+      Shard& shard = *sp;
+      std::lock_guard<std::mutex> g(shard.mu);
+      bump_epoch(shard);  // see erase()
+      for (auto it = shard.map.begin(); it != shard.map.end();) {
+        if (pred(it->first)) {
+          shard.list.erase(it->second.pos);
+          it = shard.map.erase(it);
+          removed++;
+        } else {
+          ++it;
+        }
+      }
+    }
+    return removed;
+  }
+
+  // Completes a reload requested through the refresh hook. The result is
+  // dropped if the entry was written, erased or re-inserted in the meantime.
+  // loaded == false means the reload failed; the entry becomes eligible again.
+  // version is the reloaded row's; the entry keeps the larger of it and its
+  // own, so later put()s are still checked against a real version.
+  void finish_refresh(const std::string& key, uint64_t gen, bool loaded,
+                      const std::optional<V>& value, uint64_t version = 0) {
     auto& shard = *get_shard(key);
     std::lock_guard<std::mutex> g(shard.mu);
-    
+
     auto it = shard.map.find(key);
-    if (it != shard.map.end()) {
-      it->second.first = value;
-      touch(shard, it);
+    if (it == shard.map.end() || it->second.gen != gen) return;
+
+    if (!loaded) {
+      it->second.refreshing = false;
       return;
     }
-
-    if (shard.list.size() == shard.capacity) {
-      auto k = shard.list.back();
-      shard.list.pop_back();
-      shard.map.erase(k);
+    bump_epoch(shard);
+    if (!value) {
+      // Deleted underneath us
+      shard.list.erase(it->second.pos);
+      shard.map.erase(it);
+      return;
     }
+    reload(shard, it->second, *value, std::max(it->second.version, version));
+  }
 
-    shard.list.push_front(key);
-    shard.map[key] = {value, shard.list.begin()};
+  // Copies one shard's live entries, most recently used first. Used for
+  // snapshots; holds the shard lock only while copying.
+  std::vector<std::pair<std::string, V>> snapshot_shard(size_t idx) const {
+    const Shard& shard = *shards_[idx];
+    std::vector<std::pair<std::string, V>> out;
+    std::lock_guard<std::mutex> g(shard.mu);
+    out.reserve(shard.map.size());
+    auto now = Clock::now();
+    for (const auto& key : shard.list) {
+      const Entry& e = shard.map.find(key)->second;
+      if (timed_ && policy_.ttl.count() > 0 && now - e.loaded_at >= policy_.ttl) continue;
+      out.emplace_back(key, e.value);
+    }
+    return out;
   }
 
-  void erase(const std::string& key) {
+  // Adds an entry at the cold end of its shard, unless the key is already
+  // cached or the shard is full. Warming from a snapshot hottest-first
+  // therefore keeps the saved LRU order and never evicts newer entries.
+  bool restore(const std::string& key, const V& value) {
     auto& shard = *get_shard(key);
     std::lock_guard<std::mutex> g(shard.mu);
-    
-    auto it = shard.map.find(key);
-    if (it == shard.map.end()) return;
-    
-    shard.list.erase(it->second.second);
-    shard.map.erase(it);
+
+    if (shard.list.size() >= shard.capacity || shard.map.count(key)) return false;
+    bump_epoch(shard);
+    shard.list.push_back(key);
+    Entry& e = shard.map[key];
+    e.pos = std::prev(shard.list.end());
+    reload(shard, e, value);
+    return true;
   }
 
+  size_t shards() const { return shards_.size(); }
+
   size_t size() const {
     size_t total = 0;
     for (const auto& shard : shards_) {
@@ -71,40 +238,112 @@ public:
     return total;
   }
 
+  // Bumped under the shard lock by every write, erase and refresh result.
+  // Lock-free to read, so per-thread near-caches can validate cheaply.
+  uint64_t epoch(size_t shard) const {
+    return shards_[shard]->epoch.load(std::memory_order_acquire);
+  }
+
+  static size_t shard_index(size_t hash) { return hash % NUM_SHARDS; }
+
+  uint64_t refreshes() const { return refreshes_.load(); }
+  uint64_t stale_hits() const { return stale_hits_.load(); }
+  uint64_t expired() const { return expired_.load(); }
+
 private:
   // Number of shards - more shards = less contention
   // 16 is good for 4 cores, 32 for 8+ cores
   static constexpr size_t NUM_SHARDS = 16;
-  
+
   using ListIt = std::list<std::string>::iterator;
-  
+
+  struct Entry {
+    V value;
+    ListIt pos;
+    Clock::time_point loaded_at;
+    uint64_t gen = 0;        // changes on every load; guards refresh results
+    uint64_t version = 0;    // DB row version, 0 = unknown
+    uint32_t hits = 0;       // reads since last load
+    bool refreshing = false; // a reload is in flight
+  };
+
+  using MapIt = typename std::unordered_map<std::string, Entry>::iterator;
+
   struct Shard {
-    mutable std::mutex mu;
+    // Own cache line: read on every near-cache hit, written rarely
+    alignas(64) std::atomic<uint64_t> epoch{0};
+    alignas(64) mutable std::mutex mu;
     std::list<std::string> list;
-    std::unordered_map<std::string, std::pair<std::string, ListIt>> map;
+    std::unordered_map<std::string, Entry> map;
     size_t capacity;
-    
+    uint64_t next_gen = 0;
+
     explicit Shard(size_t cap) : capacity(cap) {}
   };
-  
+
   std::vector<std::unique_ptr<Shard>> shards_;
   size_t cap_;
-  
+
+  CachePolicy policy_;
+  RefreshHook refresh_hook_;
+  bool timed_ = false;
+
+  std::atomic<uint64_t> refreshes_{0}, stale_hits_{0}, expired_{0};
+
   // Hash function to determine which shard a key belongs to
+  static size_t shard_index(const std::string& key) {
+    return shard_index(std::hash<std::string>{}(key));
+  }
+
   Shard* get_shard(const std::string& key) {
-    size_t hash = std::hash<std::string>{}(key);
-    return shards_[hash % NUM_SHARDS].get();
+    return shards_[shard_index(key)].get();
   }
-  
+
   const Shard* get_shard(const std::string& key) const {
-    size_t hash = std::hash<std::string>{}(key);
-    return shards_[hash % NUM_SHARDS].get();
+    return shards_[shard_index(key)].get();
+  }
+
+  static void bump_epoch(Shard& shard) {
+    shard.epoch.fetch_add(1, std::memory_order_release);
   }
-  
-  void touch(Shard& shard, 
-             typename std::unordered_map<std::string, std::pair<std::string, ListIt>>::iterator it) {
-    shard.list.erase(it->second.second);
+
+  void touch(Shard& shard, MapIt it) {
+    shard.list.erase(it->second.pos);
     shard.list.push_front(it->first);
-    it->second.second = shard.list.begin();
+    it->second.pos = shard.list.begin();
+  }
+
+  void put_locked(Shard& shard, const std::string& key, const V& value,
+                  uint64_t version) {
+    auto it = shard.map.find(key);
+    if (it != shard.map.end() && version != 0 && it->second.version > version) return;
+    bump_epoch(shard);
+    if (it != shard.map.end()) {
+      reload(shard, it->second, value, version);
+      touch(shard, it);
+      return;
+    }
+
+    if (shard.list.size() == shard.capacity) {
+      auto k = shard.list.back();
+      shard.list.pop_back();
+      shard.map.erase(k);
+    }
+
+    shard.list.push_front(key);
+    Entry& e = shard.map[key];
+    e.pos = shard.list.begin();
+    reload(shard, e, value, version);
   }
-};
\ No newline at end of file
+
+  void reload(Shard& shard, Entry& e, const V& value, uint64_t version = 0) {
+    e.value = value;
+    e.version = version;
+    e.gen = ++shard.next_gen;
+    e.hits = 0;
+    e.refreshing = false;
+    if (timed_) e.loaded_at = Clock::now();
+  }
+};
+
+using LRUCache = BasicLRUCache<std::string>;
@@ -0,0 +1,104 @@
+#pragma once
+#include "lru_cache.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Sampled frequency detector. Every sample_every-th lookup is counted in a
+// small hashed table (collisions only make a key look hotter than it is);
+// counters are halved periodically so keys that cool down drop out.
+// Not thread-safe: meant to be owned by a single thread.
+class HotKeyDetector {
+public:
+  HotKeyDetector(uint32_t sample_every = 8, uint16_t threshold = 4)
+      : sample_every_(sample_every ? sample_every : 1), threshold_(threshold) {
+    counts_.fill(0);
+  }
+
+  // Records a lookup and reports whether the key is currently hot.
+  bool record(size_t hash) {
+    uint16_t& c = counts_[(hash >> 7) & (TABLE_SIZE - 1)];
+    if (++tick_ % sample_every_ == 0) {
+      if (c < UINT16_MAX) c++;
+      if (++samples_ % DECAY_EVERY == 0) {
+        for (auto& v : counts_) v >>= 1;
+      }
+    }
+    return c >= threshold_;
+  }
+
+private:
+  static constexpr size_t TABLE_SIZE = 1024;
+  static constexpr uint64_t DECAY_EVERY = 4096;
+
+  std::array<uint16_t, TABLE_SIZE> counts_;
+  uint32_t sample_every_;
+  uint16_t threshold_;
+  uint64_t tick_ = 0;
+  uint64_t samples_ = 0;
+};
+
+// Per-thread L1 in front of LRUCache for keys the detector flags as hot.
+// Direct-mapped and owned by one thread, so lookups take no locks. A copy is
+// served only while the owning LRUCache shard's epoch is unchanged, and every
+// write or delete bumps that epoch before it is acknowledged, so a written or
+// deleted key is never served from here afterwards.
+class NearCache {
+public:
+  NearCache() = default;
+
+  void init(size_t slots, uint32_t sample_every, uint16_t threshold) {
+    size_t n = 1;
+    while (n < slots) n <<= 1;
+    slots_.assign(n, Slot{});
+    detector_ = HotKeyDetector(sample_every, threshold);
+  }
+
+  bool enabled() const { return !slots_.empty(); }
+
+  std::optional<std::string> get(const LRUCache& l2, const std::string& key, size_t hash) {
+    Slot& s = slot(hash);
+    if (!s.used || s.hash != hash || s.key != key) return std::nullopt;
+    if (l2.epoch(s.stamp.shard) != s.stamp.epoch ||
+        LRUCache::Clock::now() >= s.stamp.expires_at) {
+      s.used = false;
+      return std::nullopt;
+    }
+    // Every TOUCH_EVERY-th hit goes to L2 instead, so the hottest keys keep
+    // their recency and refresh-ahead bookkeeping there
+    if (++s.hits % TOUCH_EVERY == 0) return std::nullopt;
+    return s.value;
+  }
+
+  // Called after an L2 hit; keeps a copy only if the key is hot.
+  void offer(const std::string& key, size_t hash, const std::string& value,
+             const LRUCache::ReadStamp& stamp) {
+    if (!detector_.record(hash)) return;
+    Slot& s = slot(hash);
+    s.key = key;
+    s.value = value;
+    s.hash = hash;
+    s.stamp = stamp;
+    s.hits = 0;
+    s.used = true;
+  }
+
+private:
+  static constexpr uint32_t TOUCH_EVERY = 32;
+
+  struct Slot {
+    std::string key;
+    std::string value;
+    size_t hash = 0;
+    LRUCache::ReadStamp stamp;
+    uint32_t hits = 0;
+    bool used = false;
+  };
+
+  Slot& slot(size_t hash) { return slots_[hash & (slots_.size() - 1)]; }
+
+  std::vector<Slot> slots_;
+  HotKeyDetector detector_;
+};
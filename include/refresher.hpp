@@ -0,0 +1,48 @@
+#pragma once
+#include "db.hpp"
+#include "lru_cache.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background reload pool for refresh-ahead / stale-while-revalidate.
+// Each worker owns its own DB connection and reports results back to the
+// cache via LRUCache::finish_refresh(), so readers never wait on a reload.
+class Refresher {
+public:
+  Refresher(LRUCache& cache, const DBConfig& dc, int workers, size_t max_queue);
+  ~Refresher();
+
+  // Non-blocking. Drops the request (and releases the entry) when the
+  // queue is full, so a slow DB can't grow memory without bound.
+  void enqueue(const std::string& key, uint64_t gen);
+
+  uint64_t completed() const { return completed_.load(); }
+  uint64_t failed() const { return failed_.load(); }
+  uint64_t dropped() const { return dropped_.load(); }
+
+private:
+  struct Task {
+    std::string key;
+    uint64_t gen;
+  };
+
+  void run();
+
+  LRUCache& cache_;
+  DBConfig dc_;
+  size_t max_queue_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<Task> queue_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+
+  std::atomic<uint64_t> completed_{0}, failed_{0}, dropped_{0};
+};
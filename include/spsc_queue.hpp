@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free single-producer/single-consumer ring.
+// Exactly one thread may push and exactly one thread may pop.
+template <typename T>
+class SpscQueue {
+public:
+  explicit SpscQueue(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n <<= 1;
+    buf_.resize(n);
+    mask_ = n - 1;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Producer side. Returns false when the ring is full.
+  bool try_push(const T& v) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) return false;
+    }
+    buf_[tail & mask_] = v;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when the ring is empty.
+  bool try_pop(T& out) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    out = buf_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::vector<T> buf_;
+  size_t mask_ = 0;
+
+  // Producer and consumer indices live on separate cache lines, each next
+  // to the side's private copy of the other index.
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+};
@@ -1,9 +1,26 @@
 #pragma once
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <utility>
 #include "cpp-httplib/httplib.h"
 
 namespace util {
 
+// Simple JSON builder: {"k":"v"}
+std::string json_kv(const std::string& k, const std::string& v);
+
+// Minimal JSON parser for {"key":"..","value":".."}; empty strings on failure
+std::pair<std::string, std::string> parse_json_kv(const std::string& body);
+
+// One field of a flat JSON object, string or bare number: {"by":5} and
+// {"by":"5"} both give "5". nullopt when absent.
+std::optional<std::string> json_field(const std::string& body, const std::string& name);
+
+// CPU time (user + system) this process has used, from /proc/self/stat;
+// 0 where /proc is unavailable.
+uint64_t process_cpu_us();
+
 inline void ok(httplib::Response& res, const std::string& body) {
   res.status = 200;
   res.set_header("Content-Type", "application/json");
@@ -22,10 +39,30 @@ inline void not_found(httplib::Response& res) {
   res.set_content("{\"error\":\"not found\"}", "application/json");
 }
 
+// body carries the current state, e.g. {"error":..,"value":..,"version":..}
+inline void conflict(httplib::Response& res, const std::string& body) {
+  res.status = 409;
+  res.set_header("Content-Type", "application/json");
+  res.set_content(body, "application/json");
+}
+
 inline void server_err(httplib::Response& res) {
   res.status = 500;
   res.set_header("Content-Type", "application/json");
   res.set_content("{\"error\":\"server error\"}", "application/json");
 }
 
+inline void unavailable(httplib::Response& res, int retry_after_s) {
+  res.status = 503;
+  res.set_header("Retry-After", std::to_string(retry_after_s));
+  res.set_header("Content-Type", "application/json");
+  res.set_content("{\"error\":\"overloaded\"}", "application/json");
+}
+
+inline void deadline_exceeded(httplib::Response& res) {
+  res.status = 504;
+  res.set_header("Content-Type", "application/json");
+  res.set_content("{\"error\":\"deadline exceeded\"}", "application/json");
+}
+
 } // namespace util
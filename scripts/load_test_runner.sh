@@ -1,5 +1,9 @@
 #!/bin/bash
 
+# For new measurements prefer `loadgen --sweep` (see README, Capacity sweeps):
+# one process runs every step, adds warmup, percentiles, server metrics and
+# CPU, and writes a single JSON results file.
+
 # Configuration
 LOAD_GEN="/home/aditya/cs744/decs_project/build/loadgen"
 OUTPUT_CSV="load_test_results.csv"
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Starts one kvserver per node in a membership file, all on this host.
+# Usage: ./run_cluster.sh [membership file] [forward|redirect]
+
+KVSERVER="${KVSERVER:-./build/kvserver}"
+CONF="${1:-scripts/cluster_local.conf}"
+MODE="${2:-forward}"
+
+if [ ! -f "$KVSERVER" ]; then
+    echo "Error: kvserver binary not found at $KVSERVER"
+    exit 1
+fi
+
+PIDS=()
+while read -r id addr _; do
+    case "$id" in ''|'#'*|vnodes) continue ;; esac
+    port="${addr##*:}"
+    echo "Starting $id on port $port"
+    CLUSTER_FILE="$CONF" CLUSTER_SELF="$id" CLUSTER_MODE="$MODE" SRV_PORT="$port" \
+        "$KVSERVER" > "kvserver_$id.log" 2>&1 &
+    PIDS+=($!)
+done < "$CONF"
+
+echo "Cluster running (pids: ${PIDS[*]}). Press Ctrl-C to stop."
+trap 'kill "${PIDS[@]}" 2>/dev/null; exit 0' INT TERM
+wait
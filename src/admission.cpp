@@ -0,0 +1,96 @@
+#include "admission.hpp"
+#include <algorithm>
+#include <cmath>
+
+// ---- AdaptiveLimiter ----
+
+AdaptiveLimiter::AdaptiveLimiter(const Options& opts) : opts_(opts) {
+  opts_.min = std::max(1, opts_.min);
+  opts_.max = std::max(opts_.min, opts_.max);
+  limit_.store(std::clamp(opts_.initial, opts_.min, opts_.max));
+}
+
+bool AdaptiveLimiter::try_acquire() {
+  int cur = inflight_.load(std::memory_order_relaxed);
+  while (cur < limit_.load(std::memory_order_relaxed)) {
+    if (inflight_.compare_exchange_weak(cur, cur + 1, std::memory_order_acquire)) return true;
+  }
+  return false;
+}
+
+void AdaptiveLimiter::release(std::chrono::microseconds latency, bool ok) {
+  inflight_.fetch_sub(1, std::memory_order_release);
+
+  std::lock_guard<std::mutex> g(mu_);
+  int64_t prev = ewma_us_.load(std::memory_order_relaxed);
+  int64_t lat = latency.count();
+  ewma_us_.store(prev == 0 ? lat : (prev * 4 + lat) / 5, std::memory_order_relaxed);
+
+  int lim = limit_.load(std::memory_order_relaxed);
+  if (!ok || latency > opts_.target) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_decrease_ >= opts_.target) {
+      int next = static_cast<int>(std::floor(lim * opts_.backoff));
+      limit_.store(std::max(opts_.min, next), std::memory_order_relaxed);
+      last_decrease_ = now;
+    }
+    successes_ = 0;
+  } else if (++successes_ >= lim) {
+    successes_ = 0;
+    limit_.store(std::min(opts_.max, lim + 1), std::memory_order_relaxed);
+  }
+}
+
+// ---- AdmissionController ----
+
+AdmissionController::Permit& AdmissionController::Permit::operator=(Permit&& o) noexcept {
+  if (this != &o) {
+    release();
+    ac_ = o.ac_;
+    limited_ = o.limited_;
+    start_ = o.start_;
+    granted_ = o.granted_;
+    ok_ = o.ok_;
+    o.ac_ = nullptr;
+    o.granted_ = false;
+  }
+  return *this;
+}
+
+void AdmissionController::Permit::release() {
+  if (!ac_) return;
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_);
+  ac_->db_ops_++;
+  ac_->db_time_us_ += elapsed.count();
+  if (limited_) ac_->db_.release(elapsed, ok_);
+  ac_ = nullptr;
+}
+
+AdmissionController::AdmissionController(const Options& opts)
+    : opts_(opts), db_(opts.db) {}
+
+AdmissionController::Permit AdmissionController::acquire_db(Clock::time_point deadline) {
+  Permit p;
+  if (!opts_.enabled) {
+    p.ac_ = this;
+    p.start_ = Clock::now();
+    p.granted_ = true;
+    return p;
+  }
+
+  // Not worth starting if the DB can't answer before the client gives up
+  if (deadline != Clock::time_point::max() && Clock::now() + db_.latency() > deadline) {
+    shed_deadline_++;
+    return p;
+  }
+  if (!db_.try_acquire()) {
+    shed_++;
+    return p;
+  }
+
+  p.ac_ = this;
+  p.limited_ = true;
+  p.start_ = Clock::now();
+  p.granted_ = true;
+  return p;
+}
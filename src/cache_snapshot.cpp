@@ -0,0 +1,327 @@
+#include "cache_snapshot.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+// File layout, host byte order (a snapshot is read back on the host that
+// wrote it):
+//   Header
+//   Section[header.sections]       offsets are from the start of the file
+//   per section, hottest entry first:
+//     u32 key_len, u32 value_len, u32 crc32(lengths, key, value), key, value
+static constexpr char MAGIC[8] = {'K', 'V', 'S', 'N', 'A', 'P', '1', '\n'};
+static constexpr uint32_t VERSION = 1;
+
+// Keys are validated against the DB this many at a time
+static constexpr size_t VALIDATE_BATCH = 1000;
+
+// The watermark is set this far before the DB clock reading. A write that
+// committed just before the reading may not have reached this cache (or,
+// via the invalidation bus, a peer's cache) when the shards are copied;
+// such keys look changed after the watermark and are dropped on restore.
+static constexpr int64_t WATERMARK_SLACK_US = 1000000;
+
+namespace {
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sections;
+    int64_t watermark_us;
+    uint64_t written_unix_ms;
+    uint64_t entries;
+    uint32_t table_crc;
+    uint32_t header_crc;  // of all fields above
+  };
+
+  struct Section {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t entries;
+  };
+
+  struct RecordHeader {
+    uint32_t key_len;
+    uint32_t value_len;
+    uint32_t crc;
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  uint64_t ms_since(Clock::time_point t0) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t0).count();
+  }
+}
+
+// ---- CRC-32 (IEEE) ----
+
+static const std::array<uint32_t, 256>& crc_table() {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  return table;
+}
+
+static uint32_t crc32(const void* data, size_t len, uint32_t crc = 0) {
+  const auto& t = crc_table();
+  const auto* p = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < len; ++i) crc = t[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static uint32_t record_crc(uint32_t key_len, uint32_t value_len,
+                           std::string_view key, std::string_view value) {
+  uint32_t lens[2] = {key_len, value_len};
+  uint32_t crc = crc32(lens, sizeof(lens));
+  crc = crc32(key.data(), key.size(), crc);
+  return crc32(value.data(), value.size(), crc);
+}
+
+// ---- CacheSnapshot ----
+
+CacheSnapshot::CacheSnapshot(const DBConfig& dc, std::string path, size_t sections,
+                             DumpFn dump)
+    : dc_(dc), path_(std::move(path)), sections_(sections), dump_(std::move(dump)) {}
+
+CacheSnapshot::~CacheSnapshot() {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (periodic_.joinable()) periodic_.join();
+}
+
+CacheSnapshot::Counters CacheSnapshot::counters() const {
+  return {writes_.load(), write_errors_.load(), last_write_entries_.load(),
+          last_write_ms_.load(), restored_.load(), dropped_corrupt_.load(),
+          dropped_stale_.load(), restore_ms_.load()};
+}
+
+void CacheSnapshot::start_periodic(int interval_s) {
+  if (interval_s <= 0 || periodic_.joinable()) return;
+  periodic_ = std::thread([this, interval_s] { periodic_loop(interval_s); });
+}
+
+void CacheSnapshot::periodic_loop(int interval_s) {
+  std::unique_lock<std::mutex> lk(mu_);
+  while (!cv_.wait_for(lk, std::chrono::seconds(interval_s), [this] { return stop_; })) {
+    lk.unlock();
+    write();
+    lk.lock();
+  }
+}
+
+bool CacheSnapshot::write() {
+  std::lock_guard<std::mutex> g(write_mu_);
+  auto t0 = Clock::now();
+
+  // Without the DB clock a snapshot could never be validated; skip it
+  if (!write_db_connected_) write_db_connected_ = write_db_.connect(dc_);
+  std::optional<int64_t> now_us;
+  if (write_db_connected_) now_us = write_db_.now_us();
+  if (!now_us) {
+    write_db_connected_ = false;
+    write_errors_++;
+    std::cerr << "Snapshot: DB clock unavailable, not writing " << path_ << "\n";
+    return false;
+  }
+
+  std::string tmp = path_ + ".tmp";
+  FILE* f = std::fopen(tmp.c_str(), "wb");
+  if (!f) {
+    write_errors_++;
+    std::cerr << "Snapshot: cannot create " << tmp << ": " << std::strerror(errno) << "\n";
+    return false;
+  }
+
+  Header h{};
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.sections = static_cast<uint32_t>(sections_);
+  h.watermark_us = *now_us - WATERMARK_SLACK_US;
+  h.written_unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  std::vector<Section> table(sections_);
+  bool ok = std::fseek(f, sizeof(Header) + sizeof(Section) * sections_, SEEK_SET) == 0;
+  uint64_t offset = sizeof(Header) + sizeof(Section) * sections_;
+  std::string buf;
+  for (size_t i = 0; ok && i < sections_; ++i) {
+    Entries entries = dump_(i);
+    buf.clear();
+    for (const auto& [key, value] : entries) {
+      RecordHeader r;
+      r.key_len = static_cast<uint32_t>(key.size());
+      r.value_len = static_cast<uint32_t>(value.size());
+      r.crc = record_crc(r.key_len, r.value_len, key, value);
+      buf.append(reinterpret_cast<const char*>(&r), sizeof(r));
+      buf += key;
+      buf += value;
+    }
+    table[i] = {offset, buf.size(), entries.size()};
+    offset += buf.size();
+    h.entries += entries.size();
+    ok = std::fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+  }
+
+  h.table_crc = crc32(table.data(), sizeof(Section) * table.size());
+  h.header_crc = crc32(&h, offsetof(Header, header_crc));
+  ok = ok && std::fseek(f, 0, SEEK_SET) == 0 &&
+       std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+       std::fwrite(table.data(), sizeof(Section), table.size(), f) == table.size() &&
+       std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+    write_errors_++;
+    std::cerr << "Snapshot: writing " << path_ << " failed: " << std::strerror(errno) << "\n";
+    std::remove(tmp.c_str());
+    return false;
+  }
+
+  writes_++;
+  last_write_entries_ = h.entries;
+  last_write_ms_ = ms_since(t0);
+  return true;
+}
+
+size_t CacheSnapshot::restore(int threads, const RestoreFn& restore, const SeqFn& seq) {
+  auto t0 = Clock::now();
+
+  int fd = open(path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      std::cerr << "Snapshot: cannot open " << path_ << ": " << std::strerror(errno) << "\n";
+    }
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    std::cerr << "Snapshot: " << path_ << " is truncated, ignoring it\n";
+    close(fd);
+    return 0;
+  }
+  size_t size = st.st_size;
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << "Snapshot: mmap failed: " << std::strerror(errno) << "\n";
+    return 0;
+  }
+  madvise(map, size, MADV_WILLNEED);
+  const char* base = static_cast<const char*>(map);
+
+  Header h;
+  std::memcpy(&h, base, sizeof(h));
+  uint64_t table_end = sizeof(Header) + uint64_t{h.sections} * sizeof(Section);
+  bool valid = std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.version == VERSION &&
+               h.header_crc == crc32(&h, offsetof(Header, header_crc)) &&
+               table_end <= size &&
+               h.table_crc == crc32(base + sizeof(Header), table_end - sizeof(Header));
+  if (!valid) {
+    std::cerr << "Snapshot: " << path_ << " has a bad header, ignoring it\n";
+    munmap(map, size);
+    return 0;
+  }
+
+  std::vector<Section> table(h.sections);
+  std::memcpy(table.data(), base + sizeof(Header), sizeof(Section) * table.size());
+
+  // One section at a time per loader; batches within a section keep order
+  auto load_section = [&](DB& db, bool& connected, const Section& s) {
+    if (s.offset < table_end || s.offset > size || s.bytes > size - s.offset) {
+      dropped_corrupt_ += s.entries;
+      return;
+    }
+    const char* p = base + s.offset;
+    const char* end = p + s.bytes;
+    uint64_t parsed = 0;
+
+    std::vector<std::pair<std::string_view, std::string_view>> batch;
+    std::vector<std::string> keys;
+    auto flush = [&] {
+      if (batch.empty()) return;
+      keys.clear();
+      for (const auto& e : batch) keys.emplace_back(e.first);
+
+      uint64_t seq0 = seq ? seq() : 0;
+      if (!connected) connected = db.connect(dc_);
+      std::optional<std::vector<std::string>> current;
+      if (connected) current = db.unchanged_before(keys, h.watermark_us);
+      if (!current || (seq && seq() != seq0)) {
+        // Can't prove these are current; a cold miss is the safe choice
+        if (!current) connected = false;
+        dropped_stale_ += batch.size();
+        batch.clear();
+        return;
+      }
+
+      std::unordered_set<std::string_view> fresh(current->begin(), current->end());
+      Entries entries;
+      entries.reserve(fresh.size());
+      for (const auto& [key, value] : batch) {
+        if (fresh.count(key)) entries.emplace_back(key, value);
+      }
+      dropped_stale_ += batch.size() - entries.size();
+      restored_ += restore(std::move(entries));
+      batch.clear();
+    };
+
+    while (p < end) {
+      RecordHeader r;
+      if (static_cast<size_t>(end - p) < sizeof(r)) break;
+      std::memcpy(&r, p, sizeof(r));
+      if (uint64_t{r.key_len} + r.value_len > static_cast<size_t>(end - p) - sizeof(r)) break;
+      std::string_view key(p + sizeof(r), r.key_len);
+      std::string_view value(key.data() + r.key_len, r.value_len);
+      // Lengths are covered by the checksum, so past a bad record the
+      // rest of the section can't be trusted to parse
+      if (r.crc != record_crc(r.key_len, r.value_len, key, value)) break;
+      p = value.data() + r.value_len;
+      parsed++;
+      batch.emplace_back(key, value);
+      if (batch.size() == VALIDATE_BATCH) flush();
+    }
+    flush();
+    if (parsed < s.entries) dropped_corrupt_ += s.entries - parsed;
+  };
+
+  std::atomic<size_t> next{0};
+  int workers = std::max(1, std::min<int>(threads, static_cast<int>(table.size())));
+  std::vector<std::thread> loaders;
+  for (int i = 0; i < workers; ++i) {
+    loaders.emplace_back([&] {
+      DB db;
+      bool connected = false;
+      for (size_t s; (s = next.fetch_add(1)) < table.size();) {
+        load_section(db, connected, table[s]);
+      }
+    });
+  }
+  for (auto& t : loaders) t.join();
+  munmap(map, size);
+
+  restore_ms_ = ms_since(t0);
+  std::cout << "Snapshot: restored " << restored_.load() << " of " << h.entries
+            << " entries from " << path_ << " in " << restore_ms_.load() << " ms ("
+            << dropped_stale_.load() << " stale, " << dropped_corrupt_.load()
+            << " corrupt, " << workers << " loaders)\n";
+  return restored_.load();
+}
@@ -0,0 +1,157 @@
+#include "compress.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace compress {
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr int HASH_BITS = 14;
+
+static constexpr char TAG_RAW = 'R';
+static constexpr char TAG_LZ = 'Z';
+
+static uint32_t read32(const char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static size_t hash4(uint32_t v) {
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Lengths >= 15 spill into extra bytes: 255 each, then the remainder
+static void put_length(std::string& out, size_t n) {
+  for (n -= 15; n >= 255; n -= 255) out += static_cast<char>(255);
+  out += static_cast<char>(n);
+}
+
+static void put_sequence(std::string& out, const char* lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+  size_t ml = match_len ? match_len - MIN_MATCH : 0;
+  out += static_cast<char>((std::min<size_t>(lit_len, 15) << 4) | std::min<size_t>(ml, 15));
+  if (lit_len >= 15) put_length(out, lit_len);
+  out.append(lit, lit_len);
+  if (match_len == 0) return;  // final, literals-only sequence
+  out += static_cast<char>(offset & 0xFF);
+  out += static_cast<char>(offset >> 8);
+  if (ml >= 15) put_length(out, ml);
+}
+
+void lz_compress(const char* data, size_t len, std::string& out) {
+  out.clear();
+  out.reserve(len / 2 + 16);
+  std::vector<uint32_t> table(size_t{1} << HASH_BITS, UINT32_MAX);
+
+  size_t anchor = 0;  // start of pending literals
+  size_t i = 0;
+  while (i + MIN_MATCH <= len) {
+    uint32_t v = read32(data + i);
+    size_t h = hash4(v);
+    size_t cand = table[h];
+    table[h] = static_cast<uint32_t>(i);
+
+    if (cand == UINT32_MAX || i - cand > MAX_OFFSET || read32(data + cand) != v) {
+      i++;
+      continue;
+    }
+
+    size_t n = MIN_MATCH;
+    while (i + n < len && data[cand + n] == data[i + n]) n++;
+    put_sequence(out, data + anchor, i - anchor, i - cand, n);
+    i += n;
+    anchor = i;
+  }
+  put_sequence(out, data + anchor, len - anchor, 0, 0);
+}
+
+// Reads an extended length; false if the input ends first
+static bool get_length(const unsigned char*& p, const unsigned char* end, size_t& n) {
+  unsigned char b;
+  do {
+    if (p == end) return false;
+    b = *p++;
+    n += b;
+  } while (b == 255);
+  return true;
+}
+
+bool lz_decompress(const char* data, size_t len, size_t raw_len, std::string& out) {
+  out.resize(raw_len);
+  char* dst = out.data();
+  size_t pos = 0;
+  auto p = reinterpret_cast<const unsigned char*>(data);
+  auto end = p + len;
+
+  while (p < end) {
+    unsigned char token = *p++;
+    size_t lit = token >> 4;
+    if (lit == 15 && !get_length(p, end, lit)) return false;
+    if (lit > static_cast<size_t>(end - p) || lit > raw_len - pos) return false;
+    std::memcpy(dst + pos, p, lit);
+    p += lit;
+    pos += lit;
+    if (p == end) break;  // final sequence has no match
+
+    if (end - p < 2) return false;
+    size_t offset = p[0] | (size_t{p[1]} << 8);
+    p += 2;
+    size_t match = token & 0x0F;
+    if (match == 15 && !get_length(p, end, match)) return false;
+    match += MIN_MATCH;
+    if (offset == 0 || offset > pos || match > raw_len - pos) return false;
+
+    // Byte by byte: the match may overlap the bytes it produces
+    const char* src = dst + pos - offset;
+    for (size_t k = 0; k < match; ++k) dst[pos + k] = src[k];
+    pos += match;
+  }
+  return pos == raw_len;
+}
+
+std::string pack(const char* data, size_t len, size_t min_size) {
+  std::string out;
+  if (min_size > 0 && len >= min_size && len <= UINT32_MAX) {
+    std::string z;
+    lz_compress(data, len, z);
+    if (z.size() + 5 <= len - len / 8) {
+      uint32_t raw = static_cast<uint32_t>(len);
+      out.reserve(z.size() + 5);
+      out += TAG_LZ;
+      out.append(reinterpret_cast<const char*>(&raw), sizeof(raw));
+      out += z;
+      return out;
+    }
+  }
+  out.reserve(len + 1);
+  out += TAG_RAW;
+  out.append(data, len);
+  return out;
+}
+
+bool unpack(const std::string& packed, std::string& out) {
+  if (packed.empty()) return false;
+  if (packed[0] == TAG_RAW) {
+    out.assign(packed, RAW_OFFSET, std::string::npos);
+    return true;
+  }
+  if (packed[0] != TAG_LZ || packed.size() < 5) return false;
+  return lz_decompress(packed.data() + 5, packed.size() - 5, unpacked_size(packed), out);
+}
+
+bool is_raw(const std::string& packed) {
+  return !packed.empty() && packed[0] == TAG_RAW;
+}
+
+size_t unpacked_size(const std::string& packed) {
+  if (packed.empty()) return 0;
+  if (packed[0] != TAG_LZ || packed.size() < 5) return packed.size() - 1;
+  uint32_t raw;
+  std::memcpy(&raw, packed.data() + 1, sizeof(raw));
+  return raw;
+}
+
+} // namespace compress
@@ -0,0 +1,264 @@
+#include "core_executor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <pthread.h>
+#include <sched.h>
+
+// ---- Partition ----
+
+std::optional<std::string> CoreExecutor::Partition::get(const std::string& key) {
+  auto it = map_.find(key);
+  if (it == map_.end()) return std::nullopt;
+  list_.splice(list_.begin(), list_, it->second.pos);
+  return it->second.value;
+}
+
+void CoreExecutor::Partition::put(const std::string& key, const std::string& value,
+                                  uint64_t version) {
+  auto it = map_.find(key);
+  if (it != map_.end()) {
+    if (version != 0 && it->second.version > version) return;
+    it->second.value = value;
+    it->second.version = version;
+    list_.splice(list_.begin(), list_, it->second.pos);
+    return;
+  }
+
+  if (map_.size() >= cap_ && !list_.empty()) {
+    map_.erase(list_.back());
+    list_.pop_back();
+  }
+
+  list_.push_front(key);
+  map_[key] = {value, list_.begin(), version};
+}
+
+void CoreExecutor::Partition::erase(const std::string& key) {
+  auto it = map_.find(key);
+  if (it == map_.end()) return;
+  list_.erase(it->second.pos);
+  map_.erase(it);
+}
+
+size_t CoreExecutor::Partition::erase_if(const std::function<bool(const std::string&)>& pred) {
+  size_t removed = 0;
+  for (auto it = map_.begin(); it != map_.end();) {
+    if (pred(it->first)) {
+      list_.erase(it->second.pos);
+      it = map_.erase(it);
+      removed++;
+    } else {
+      ++it;
+    }
+  }
+  return removed;
+}
+
+void CoreExecutor::Partition::snapshot(Entries& out) const {
+  out.reserve(map_.size());
+  for (const auto& key : list_) out.emplace_back(key, map_.find(key)->second.value);
+}
+
+size_t CoreExecutor::Partition::restore(const Entries& entries) {
+  size_t added = 0;
+  for (const auto& [key, value] : entries) {
+    if (map_.size() >= cap_) break;
+    if (map_.count(key)) continue;
+    list_.push_back(key);
+    map_[key] = {value, std::prev(list_.end()), 0};
+    added++;
+  }
+  return added;
+}
+
+// ---- CoreExecutor ----
+
+CoreExecutor::Core::Core(size_t cap, int producers) : part(cap) {
+  rings.reserve(producers);
+  for (int i = 0; i < producers; ++i) {
+    // Each producer waits for its reply, so at most one request is in flight
+    rings.push_back(std::make_unique<SpscQueue<Request*>>(4));
+  }
+}
+
+CoreExecutor::CoreExecutor(const Options& opts) : opts_(opts) {
+  if (!opts_.cpus.empty()) opts_.cores = static_cast<int>(opts_.cpus.size());
+  if (opts_.cores < 1) opts_.cores = 1;
+  if (opts_.max_producers < 1) opts_.max_producers = 1;
+
+  size_t part_cap = (opts_.capacity + opts_.cores - 1) / opts_.cores;
+  for (int i = 0; i < opts_.cores; ++i) {
+    cores_.push_back(std::make_unique<Core>(part_cap, opts_.max_producers));
+  }
+  for (int i = 0; i < opts_.cores; ++i) {
+    int cpu = opts_.cpus.empty() ? -1 : opts_.cpus[i];
+    cores_[i]->thread = std::thread([this, i, cpu] { run(*cores_[i], cpu); });
+  }
+}
+
+CoreExecutor::~CoreExecutor() {
+  stop_.store(true);
+  for (auto& c : cores_) c->thread.join();
+}
+
+int CoreExecutor::producer_id() {
+  // One executor per process; ids are never reused, threads are long-lived
+  thread_local int id = next_producer_.fetch_add(1);
+  return id;
+}
+
+void CoreExecutor::submit(Request& req) {
+  size_t hash = std::hash<std::string>{}(*req.key);
+  submit(req, *cores_[hash % cores_.size()]);
+}
+
+void CoreExecutor::submit(Request& req, Core& core, bool bulk) {
+  int pid = bulk ? opts_.max_producers : producer_id();
+  if (pid < opts_.max_producers) {
+    auto& ring = *core.rings[pid];
+    while (!ring.try_push(&req)) std::this_thread::yield();
+  } else {
+    if (!bulk) overflow_ops_++;
+    std::lock_guard<std::mutex> g(core.overflow_mu);
+    core.overflow.push_back(&req);
+    core.has_overflow.store(true, std::memory_order_release);
+  }
+
+  // Replies usually land within a few microseconds; spin briefly first
+  for (int spins = 0; !req.done.load(std::memory_order_acquire); ++spins) {
+    if (spins > 200) std::this_thread::yield();
+  }
+}
+
+std::optional<std::string> CoreExecutor::get(const std::string& key) {
+  Request req{Op::Get, &key, nullptr, std::nullopt};
+  submit(req);
+  return std::move(req.result);
+}
+
+void CoreExecutor::put(const std::string& key, const std::string& value, uint64_t version) {
+  Request req{Op::Put, &key, &value, std::nullopt};
+  req.version = version;
+  submit(req);
+}
+
+void CoreExecutor::fill(const std::string& key, const std::string& value, uint64_t version,
+                        const std::atomic<uint64_t>& seq, uint64_t seen) {
+  Request req{Op::Put, &key, &value, std::nullopt};
+  req.version = version;
+  req.seq = &seq;
+  req.seen = seen;
+  submit(req);
+}
+
+void CoreExecutor::erase(const std::string& key) {
+  Request req{Op::Erase, &key, nullptr, std::nullopt};
+  submit(req);
+}
+
+size_t CoreExecutor::erase_if(const std::function<bool(const std::string&)>& pred) {
+  size_t removed = 0;
+  for (auto& core : cores_) {
+    Request req{Op::EraseIf, nullptr, nullptr, std::nullopt};
+    req.pred = &pred;
+    submit(req, *core);
+    removed += req.removed;
+  }
+  return removed;
+}
+
+CoreExecutor::Entries CoreExecutor::snapshot(int core) {
+  Entries out;
+  Request req{Op::Snapshot, nullptr, nullptr, std::nullopt};
+  req.entries = &out;
+  submit(req, *cores_[core], true);
+  return out;
+}
+
+size_t CoreExecutor::restore(const Entries& entries) {
+  std::vector<Entries> per_core(cores_.size());
+  for (const auto& e : entries) {
+    per_core[std::hash<std::string>{}(e.first) % cores_.size()].push_back(e);
+  }
+  size_t added = 0;
+  for (size_t i = 0; i < cores_.size(); ++i) {
+    if (per_core[i].empty()) continue;
+    Request req{Op::Restore, nullptr, nullptr, std::nullopt};
+    req.entries = &per_core[i];
+    submit(req, *cores_[i], true);
+    added += req.removed;
+  }
+  return added;
+}
+
+size_t CoreExecutor::size() const {
+  size_t total = 0;
+  for (const auto& c : cores_) total += c->size.load(std::memory_order_relaxed);
+  return total;
+}
+
+void CoreExecutor::execute(Core& core, Request* req) {
+  switch (req->op) {
+    case Op::Get:   req->result = core.part.get(*req->key); break;
+    case Op::Put:
+      if (!req->seq || req->seq->load() == req->seen) {
+        core.part.put(*req->key, *req->value, req->version);
+      }
+      break;
+    case Op::Erase: core.part.erase(*req->key); break;
+    case Op::EraseIf: req->removed = core.part.erase_if(*req->pred); break;
+    case Op::Snapshot: core.part.snapshot(*req->entries); break;
+    case Op::Restore: req->removed = core.part.restore(*req->entries); break;
+  }
+  core.size.store(core.part.size(), std::memory_order_relaxed);
+  req->done.store(true, std::memory_order_release);
+}
+
+void CoreExecutor::run(Core& core, int cpu) {
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+      std::cerr << "CoreExecutor: failed to pin to CPU " << cpu << "\n";
+    }
+  }
+
+  int idle = 0;
+  std::vector<Request*> overflow;
+  while (!stop_.load(std::memory_order_relaxed)) {
+    bool worked = false;
+
+    // Only rings handed out so far can hold requests
+    int producers = std::min(next_producer_.load(std::memory_order_acquire),
+                             opts_.max_producers);
+    for (int p = 0; p < producers; ++p) {
+      Request* req;
+      while (core.rings[p]->try_pop(req)) {
+        execute(core, req);
+        worked = true;
+      }
+    }
+
+    if (core.has_overflow.load(std::memory_order_acquire)) {
+      {
+        std::lock_guard<std::mutex> g(core.overflow_mu);
+        overflow.swap(core.overflow);
+        core.has_overflow.store(false, std::memory_order_relaxed);
+      }
+      for (Request* req : overflow) execute(core, req);
+      overflow.clear();
+      worked = true;
+    }
+
+    if (worked) {
+      idle = 0;
+    } else if (++idle > opts_.idle_spins) {
+      // Back off when idle so an unloaded server doesn't pin every core
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+}
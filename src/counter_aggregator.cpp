@@ -0,0 +1,140 @@
+#include "counter_aggregator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+CounterAggregator::CounterAggregator(const DBConfig& dc, int flush_ms, ApplyFn apply)
+    : dc_(dc), flush_ms_(flush_ms > 0 ? flush_ms : 1), apply_(std::move(apply)) {
+  flusher_ = std::thread([this] { run(); });
+}
+
+CounterAggregator::~CounterAggregator() {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  flusher_.join();
+
+  // These increments were already acknowledged: retry briefly if the DB is
+  // down, then at least report what is being lost
+  for (int attempt = 0; attempt < FINAL_FLUSH_TRIES; ++attempt) {
+    if (attempt > 0) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    flush();
+    if (pending_keys() == 0) return;
+  }
+  size_t lost = 0;
+  for (auto& s : shards_) {
+    std::lock_guard<std::mutex> g(s.mu);
+    lost += s.pending.size();
+    s.pending.clear();
+  }
+  dropped_ += lost;
+  std::cerr << "Counter flush: DB unavailable at shutdown, dropping pending increments for "
+            << lost << " key(s)\n";
+}
+
+size_t CounterAggregator::pending_keys() {
+  size_t n = 0;
+  for (auto& s : shards_) {
+    std::lock_guard<std::mutex> g(s.mu);
+    n += s.pending.size();
+  }
+  return n;
+}
+
+void CounterAggregator::add(const std::string& key, int64_t delta) {
+  Shard& s = shards_[std::hash<std::string>{}(key) % NUM_SHARDS];
+  {
+    std::lock_guard<std::mutex> g(s.mu);
+    s.pending[key] += delta;
+  }
+  deferred_++;
+}
+
+CounterAggregator::Counters CounterAggregator::counters() const {
+  return {deferred_.load(), flushes_.load(), flushed_keys_.load(),
+          flush_errors_.load(), dropped_.load()};
+}
+
+void CounterAggregator::run() {
+  std::unique_lock<std::mutex> lk(mu_);
+  while (!cv_.wait_for(lk, std::chrono::milliseconds(flush_ms_), [this] { return stop_; })) {
+    lk.unlock();
+    flush();
+    lk.lock();
+  }
+}
+
+bool CounterAggregator::flush() {
+  std::lock_guard<std::mutex> g(flush_mu_);
+
+  std::vector<std::pair<std::string, int64_t>> deltas;
+  for (auto& s : shards_) {
+    std::unordered_map<std::string, int64_t> taken;
+    {
+      std::lock_guard<std::mutex> sg(s.mu);
+      taken.swap(s.pending);
+    }
+    for (auto& [key, delta] : taken) {
+      if (delta != 0) deltas.emplace_back(key, delta);
+    }
+  }
+  if (deltas.empty()) return true;
+  // Every instance locks rows in the same order, so overlapping batches
+  // wait on each other instead of deadlocking
+  std::sort(deltas.begin(), deltas.end());
+
+  auto requeue = [this](const std::vector<std::pair<std::string, int64_t>>& failed) {
+    for (const auto& [key, delta] : failed) {
+      Shard& s = shards_[std::hash<std::string>{}(key) % NUM_SHARDS];
+      std::lock_guard<std::mutex> sg(s.mu);
+      s.pending[key] += delta;
+    }
+  };
+
+  if (!connected_) connected_ = db_.connect(dc_);
+  if (!connected_) {
+    flush_errors_++;
+    requeue(deltas);
+    return false;
+  }
+
+  std::vector<std::pair<std::string, DB::Row>> rows;
+  DB::OpStatus st = db_.incr_many(deltas, rows);
+  if (st == DB::OpStatus::NotInteger) {
+    // Some key holds a non-number and failed the whole batch; fall back to
+    // one statement per key so only that key's increments are dropped
+    rows.clear();
+    std::vector<std::pair<std::string, int64_t>> failed;
+    for (const auto& [key, delta] : deltas) {
+      DB::OpResult r = db_.incr(key, delta);
+      if (r.status == DB::OpStatus::Ok) {
+        rows.emplace_back(key, std::move(r.row));
+      } else if (r.status == DB::OpStatus::NotInteger) {
+        dropped_++;
+        std::cerr << "Counter flush: '" << key << "' is not an integer, dropping "
+                  << delta << "\n";
+      } else {
+        failed.emplace_back(key, delta);
+      }
+    }
+    if (!failed.empty()) {
+      connected_ = false;
+      flush_errors_++;
+      requeue(failed);
+    }
+  } else if (st != DB::OpStatus::Ok) {
+    connected_ = false;
+    flush_errors_++;
+    requeue(deltas);
+    return false;
+  }
+
+  flushes_++;
+  flushed_keys_ += rows.size();
+  for (const auto& [key, row] : rows) apply_(key, row);
+  return true;
+}
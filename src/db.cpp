@@ -1,14 +1,16 @@
 #include <libpq-fe.h>
 #include "db.hpp"
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 DB::~DB() {
   if (conn_) PQfinish(conn_);
 }
 
-bool DB::connect(const DBConfig& cfg) {
+std::string DB::conninfo(const DBConfig& cfg) {
   (void)cfg;
-  std::string conninfo =
+  return
     "host=127.0.0.1 "
     "port=5432 "
     "user=postgres "
@@ -16,8 +18,11 @@ bool DB::connect(const DBConfig& cfg) {
     "dbname=kvdb "
     "sslmode=disable "          
     "connect_timeout=10"; 
+}
 
-  conn_ = PQconnectdb(conninfo.c_str());
+bool DB::connect(const DBConfig& cfg) {
+  if (conn_) PQfinish(conn_);
+  conn_ = PQconnectdb(conninfo(cfg).c_str());
   if (PQstatus(conn_) != CONNECTION_OK) {
     std::cerr << "Connection failed: " << PQerrorMessage(conn_);
     return false;
@@ -26,7 +31,35 @@ bool DB::connect(const DBConfig& cfg) {
   const char* ddl =
     "CREATE TABLE IF NOT EXISTS kv_store ("
     " key TEXT PRIMARY KEY,"
-    " value TEXT NOT NULL);";
+    " value TEXT NOT NULL);"
+    // Added after the fact; checked first so existing deployments don't
+    // take an exclusive table lock on every connect.
+    "DO $$ BEGIN"
+    " IF NOT EXISTS (SELECT 1 FROM information_schema.columns"
+    "  WHERE table_name = 'kv_store' AND column_name = 'updated_at') THEN"
+    "  ALTER TABLE kv_store ADD COLUMN updated_at TIMESTAMPTZ NOT NULL DEFAULT now();"
+    " END IF;"
+    " IF NOT EXISTS (SELECT 1 FROM information_schema.columns"
+    "  WHERE table_name = 'kv_store' AND column_name = 'version') THEN"
+    "  ALTER TABLE kv_store ADD COLUMN version BIGINT NOT NULL DEFAULT 1;"
+    " END IF;"
+    " END $$;"
+    "CREATE TABLE IF NOT EXISTS kv_blob ("
+    " key TEXT PRIMARY KEY,"
+    " value BYTEA NOT NULL,"
+    " version BIGINT NOT NULL DEFAULT 1,"
+    " updated_at TIMESTAMPTZ NOT NULL DEFAULT now());"
+    // Versions of both tables come from one sequence, so a key that is
+    // deleted and created again never reuses a version. A new sequence
+    // starts past every version already stored.
+    "DO $$ BEGIN"
+    " IF NOT EXISTS (SELECT 1 FROM pg_class"
+    "  WHERE relname = 'kv_version_seq' AND relkind = 'S') THEN"
+    "  CREATE SEQUENCE kv_version_seq;"
+    "  PERFORM setval('kv_version_seq', GREATEST(1,"
+    "   (SELECT max(version) FROM kv_store), (SELECT max(version) FROM kv_blob)));"
+    " END IF;"
+    " END $$;";
 
   PGresult* res = PQexec(conn_, ddl);
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -38,23 +71,40 @@ bool DB::connect(const DBConfig& cfg) {
   return true;
 }
 
-bool DB::upsert(const std::string& key, const std::string& value) {
+bool DB::connection_ok() const {
+  return conn_ && PQstatus(conn_) == CONNECTION_OK;
+}
+
+// Shared by every statement that writes a row: each write, insert or
+// update, takes the next version from kv_version_seq. The update branch
+// draws its own value once it holds the row lock, so a row's versions
+// increase in commit order.
+#define KV_NEXT_VERSION "nextval('kv_version_seq')"
+#define KV_WRITE_COLUMNS \
+  "version = " KV_NEXT_VERSION ", updated_at = EXCLUDED.updated_at "
+
+bool DB::upsert(const std::string& key, const std::string& value, uint64_t* version) {
   const char* sql =
-    "INSERT INTO kv_store (key,value) VALUES ($1,$2) "
-    "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value;";
+    "INSERT INTO kv_store (key,value,version,updated_at) "
+    "VALUES ($1,$2," KV_NEXT_VERSION ",clock_timestamp()) "
+    "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value, " KV_WRITE_COLUMNS
+    "RETURNING version;";
   const char* params[2] = { key.c_str(), value.c_str() };
   PGresult* res = PQexecParams(conn_, sql, 2, nullptr, params, nullptr, nullptr, 0);
-  bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+  bool ok = PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1;
   if (!ok) std::cerr << "Upsert failed: " << PQerrorMessage(conn_);
+  if (ok && version) *version = std::strtoull(PQgetvalue(res, 0, 0), nullptr, 10);
   PQclear(res);
   return ok;
 }
 
-std::optional<std::string> DB::get(const std::string& key) {
-  const char* sql = "SELECT value FROM kv_store WHERE key=$1;";
+std::optional<std::string> DB::get(const std::string& key, uint64_t* version, bool* error) {
+  const char* sql = "SELECT value, version FROM kv_store WHERE key=$1;";
   const char* params[1] = { key.c_str() };
   PGresult* res = PQexecParams(conn_, sql, 1, nullptr, params, nullptr, nullptr, 0);
-  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+  bool failed = PQresultStatus(res) != PGRES_TUPLES_OK;
+  if (error) *error = failed;
+  if (failed) {
     PQclear(res);
     return std::nullopt;
   }
@@ -63,6 +113,7 @@ std::optional<std::string> DB::get(const std::string& key) {
     return std::nullopt;
   }
   std::string val = PQgetvalue(res, 0, 0);
+  if (version) *version = std::strtoull(PQgetvalue(res, 0, 1), nullptr, 10);
   PQclear(res);
   return val;
 }
@@ -76,3 +127,234 @@ bool DB::erase(const std::string& key) {
   PQclear(res);
   return ok;
 }
+
+// ---- Binary values ----
+
+bool DB::put_blob(const std::string& key, const char* data, size_t len, uint64_t* version) {
+  const char* sql =
+    "INSERT INTO kv_blob (key,value,version,updated_at) "
+    "VALUES ($1,$2," KV_NEXT_VERSION ",clock_timestamp()) "
+    "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value, " KV_WRITE_COLUMNS
+    "RETURNING version::text;";
+  const char* params[2] = { key.c_str(), data };
+  int lengths[2] = { 0, static_cast<int>(len) };
+  int formats[2] = { 0, 1 };  // key as text, value as raw bytes
+  PGresult* res = PQexecParams(conn_, sql, 2, nullptr, params, lengths, formats, 0);
+  bool ok = PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1;
+  if (!ok) std::cerr << "Blob upsert failed: " << PQerrorMessage(conn_);
+  if (ok && version) *version = std::strtoull(PQgetvalue(res, 0, 0), nullptr, 10);
+  PQclear(res);
+  return ok;
+}
+
+std::optional<std::string> DB::get_blob(const std::string& key, uint64_t* version) {
+  // Binary results: value arrives as its raw bytes, version as a text
+  // cast so it needn't be byte-swapped
+  const char* sql = "SELECT value, version::text FROM kv_blob WHERE key=$1;";
+  const char* params[1] = { key.c_str() };
+  PGresult* res = PQexecParams(conn_, sql, 1, nullptr, params, nullptr, nullptr, 1);
+  if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
+    PQclear(res);
+    return std::nullopt;
+  }
+  std::string val(PQgetvalue(res, 0, 0), PQgetlength(res, 0, 0));
+  if (version) {
+    *version = std::strtoull(std::string(PQgetvalue(res, 0, 1), PQgetlength(res, 0, 1)).c_str(),
+                             nullptr, 10);
+  }
+  PQclear(res);
+  return val;
+}
+
+bool DB::erase_blob(const std::string& key) {
+  const char* sql = "DELETE FROM kv_blob WHERE key=$1;";
+  const char* params[1] = { key.c_str() };
+  PGresult* res = PQexecParams(conn_, sql, 1, nullptr, params, nullptr, nullptr, 0);
+  bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+  if (!ok) std::cerr << "Blob delete failed: " << PQerrorMessage(conn_);
+  PQclear(res);
+  return ok;
+}
+
+// Array parameters go over as one text literal, e.g. {"k1","k2"}
+template <typename It, typename Fn>
+static std::string text_array(It begin, It end, Fn field) {
+  std::string arr = "{";
+  for (It it = begin; it != end; ++it) {
+    if (it != begin) arr += ',';
+    arr += '"';
+    for (char c : field(*it)) {
+      if (c == '"' || c == '\\') arr += '\\';
+      arr += c;
+    }
+    arr += '"';
+  }
+  arr += '}';
+  return arr;
+}
+
+std::optional<int64_t> DB::now_us() {
+  PGresult* res = PQexec(conn_,
+    "SELECT (extract(epoch FROM clock_timestamp()) * 1000000)::bigint;");
+  if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1) {
+    std::cerr << "Clock query failed: " << PQerrorMessage(conn_);
+    PQclear(res);
+    return std::nullopt;
+  }
+  int64_t us = std::atoll(PQgetvalue(res, 0, 0));
+  PQclear(res);
+  return us;
+}
+
+std::optional<std::vector<std::string>> DB::unchanged_before(
+    const std::vector<std::string>& keys, int64_t before_us) {
+  std::string arr = text_array(keys.begin(), keys.end(), [](const auto& k) { return k; });
+  std::string before = std::to_string(before_us);
+
+  const char* sql =
+    "SELECT key FROM kv_store WHERE key = ANY($1::text[]) "
+    "AND updated_at < timestamptz 'epoch' + $2::bigint * interval '1 microsecond';";
+  const char* params[2] = { arr.c_str(), before.c_str() };
+  PGresult* res = PQexecParams(conn_, sql, 2, nullptr, params, nullptr, nullptr, 0);
+  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+    std::cerr << "Snapshot validation failed: " << PQerrorMessage(conn_);
+    PQclear(res);
+    return std::nullopt;
+  }
+  std::vector<std::string> out;
+  out.reserve(PQntuples(res));
+  for (int i = 0; i < PQntuples(res); ++i) {
+    out.emplace_back(PQgetvalue(res, i, 0), PQgetlength(res, i, 0));
+  }
+  PQclear(res);
+  return out;
+}
+
+// ---- Atomic operations ----
+
+// Runs a statement returning (value, version) rows and maps errors that
+// mean "the stored value isn't a number" to NotInteger.
+static DB::OpStatus run_op(PGconn* conn, const char* what, const char* sql,
+                           int nparams, const char* const* params, PGresult** out) {
+  PGresult* res = PQexecParams(conn, sql, nparams, nullptr, params, nullptr, nullptr, 0);
+  *out = res;
+  if (PQresultStatus(res) == PGRES_TUPLES_OK) return DB::OpStatus::Ok;
+
+  const char* state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+  // invalid_text_representation, numeric_value_out_of_range
+  if (state && (std::strcmp(state, "22P02") == 0 || std::strcmp(state, "22003") == 0)) {
+    return DB::OpStatus::NotInteger;
+  }
+  std::cerr << what << " failed: " << PQerrorMessage(conn);
+  return DB::OpStatus::Error;
+}
+
+static DB::Row row_of(PGresult* res, int i, int col = 0) {
+  return {std::string(PQgetvalue(res, i, col), PQgetlength(res, i, col)),
+          std::strtoull(PQgetvalue(res, i, col + 1), nullptr, 10)};
+}
+
+// incr/append: one upsert whose conflict branch combines old and new value
+static DB::OpResult combine(PGconn* conn, const char* what, const char* sql,
+                            const std::string& key, const std::string& arg) {
+  DB::OpResult r;
+  const char* params[2] = { key.c_str(), arg.c_str() };
+  PGresult* res;
+  r.status = run_op(conn, what, sql, 2, params, &res);
+  if (r.status == DB::OpStatus::Ok) r.row = row_of(res, 0);
+  PQclear(res);
+  return r;
+}
+
+DB::OpResult DB::incr(const std::string& key, int64_t delta) {
+  const char* sql =
+    "INSERT INTO kv_store (key,value,version,updated_at) "
+    "VALUES ($1,$2," KV_NEXT_VERSION ",clock_timestamp()) "
+    "ON CONFLICT (key) DO UPDATE SET "
+    "value = (kv_store.value::bigint + EXCLUDED.value::bigint)::text, " KV_WRITE_COLUMNS
+    "RETURNING value, version;";
+  return combine(conn_, "Increment", sql, key, std::to_string(delta));
+}
+
+DB::OpResult DB::append(const std::string& key, const std::string& suffix) {
+  const char* sql =
+    "INSERT INTO kv_store (key,value,version,updated_at) "
+    "VALUES ($1,$2," KV_NEXT_VERSION ",clock_timestamp()) "
+    "ON CONFLICT (key) DO UPDATE SET value = kv_store.value || EXCLUDED.value, " KV_WRITE_COLUMNS
+    "RETURNING value, version;";
+  return combine(conn_, "Append", sql, key, suffix);
+}
+
+DB::OpResult DB::cas(const std::string& key, const std::string& value, uint64_t expected) {
+  // The write and, when it doesn't apply, the current row come back from
+  // one statement. The fallback SELECT sees the statement's snapshot, so
+  // a row changed concurrently may be reported with its previous version.
+  const char* insert_sql =
+    "WITH w AS ("
+    " INSERT INTO kv_store (key,value,version,updated_at)"
+    " VALUES ($1,$2," KV_NEXT_VERSION ",clock_timestamp())"
+    " ON CONFLICT (key) DO NOTHING RETURNING value, version) "
+    "SELECT value, version, true FROM w "
+    "UNION ALL SELECT value, version, false FROM kv_store "
+    "WHERE key = $1 AND NOT EXISTS (SELECT 1 FROM w);";
+  const char* update_sql =
+    "WITH w AS ("
+    " UPDATE kv_store SET value = $2, version = " KV_NEXT_VERSION ","
+    " updated_at = clock_timestamp()"
+    " WHERE key = $1 AND version = $3::bigint RETURNING value, version) "
+    "SELECT value, version, true FROM w "
+    "UNION ALL SELECT value, version, false FROM kv_store "
+    "WHERE key = $1 AND NOT EXISTS (SELECT 1 FROM w);";
+
+  std::string exp = std::to_string(expected);
+  const char* params[3] = { key.c_str(), value.c_str(), exp.c_str() };
+  OpResult r;
+  PGresult* res;
+  r.status = expected == 0 ? run_op(conn_, "CAS", insert_sql, 2, params, &res)
+                           : run_op(conn_, "CAS", update_sql, 3, params, &res);
+  if (r.status == OpStatus::Ok) {
+    if (PQntuples(res) == 0) {
+      // Absent row: an update has nothing to compare against; an insert
+      // lost to a row committed after our snapshot
+      r.status = expected == 0 ? OpStatus::Conflict : OpStatus::NotFound;
+    } else {
+      r.row = row_of(res, 0);
+      if (PQgetvalue(res, 0, 2)[0] != 't') r.status = OpStatus::Conflict;
+    }
+  }
+  PQclear(res);
+  return r;
+}
+
+DB::OpStatus DB::incr_many(const std::vector<std::pair<std::string, int64_t>>& deltas,
+                           std::vector<std::pair<std::string, Row>>& out) {
+  const char* sql =
+    "INSERT INTO kv_store (key,value,version,updated_at) "
+    "SELECT k, d::text, " KV_NEXT_VERSION ", clock_timestamp() "
+    "FROM unnest($1::text[], $2::bigint[]) AS t(k, d) "
+    "ON CONFLICT (key) DO UPDATE SET "
+    "value = (kv_store.value::bigint + EXCLUDED.value::bigint)::text, " KV_WRITE_COLUMNS
+    "RETURNING key, value, version;";
+  std::string keys = text_array(deltas.begin(), deltas.end(),
+                                [](const auto& d) -> const std::string& { return d.first; });
+  std::string nums = "{";
+  for (size_t i = 0; i < deltas.size(); ++i) {
+    if (i) nums += ',';
+    nums += std::to_string(deltas[i].second);
+  }
+  nums += '}';
+
+  const char* params[2] = { keys.c_str(), nums.c_str() };
+  PGresult* res;
+  OpStatus st = run_op(conn_, "Batched increment", sql, 2, params, &res);
+  if (st == OpStatus::Ok) {
+    out.clear();
+    out.reserve(PQntuples(res));
+    for (int i = 0; i < PQntuples(res); ++i) {
+      out.emplace_back(std::string(PQgetvalue(res, i, 0), PQgetlength(res, i, 0)),
+                       row_of(res, i, 1));
+    }
+  }
+  PQclear(res);
+  return st;
+}
@@ -0,0 +1,100 @@
+#include "hash_ring.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+bool load_membership(const std::string& path, ClusterMembership& out, std::string& err) {
+  std::ifstream in(path);
+  if (!in) {
+    err = "cannot open " + path;
+    return false;
+  }
+
+  ClusterMembership m;
+  std::string line;
+  int lineno = 0;
+  while (std::getline(in, line)) {
+    lineno++;
+    auto hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+
+    std::istringstream ss(line);
+    std::string first, second;
+    if (!(ss >> first)) continue;
+    if (!(ss >> second)) {
+      err = path + ":" + std::to_string(lineno) + ": expected '<id> <host:port>'";
+      return false;
+    }
+
+    if (first == "vnodes") {
+      m.vnodes = std::atoi(second.c_str());
+      continue;
+    }
+
+    auto colon = second.rfind(':');
+    if (colon == std::string::npos) {
+      err = path + ":" + std::to_string(lineno) + ": missing port in '" + second + "'";
+      return false;
+    }
+    ClusterNode n;
+    n.id = first;
+    n.host = second.substr(0, colon);
+    n.port = std::atoi(second.c_str() + colon + 1);
+    m.nodes.push_back(n);
+  }
+
+  if (m.nodes.empty()) {
+    err = path + ": no nodes";
+    return false;
+  }
+  if (m.vnodes < 1) m.vnodes = 1;
+  out = std::move(m);
+  return true;
+}
+
+uint64_t HashRing::hash(const std::string& s) {
+  // FNV-1a followed by a splitmix64 finalizer to spread similar keys
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+HashRing::HashRing(const ClusterMembership& m)
+    : nodes_(m.nodes), vnodes_(m.vnodes) {
+  points_.reserve(nodes_.size() * vnodes_);
+  for (uint32_t n = 0; n < nodes_.size(); ++n) {
+    // Points depend only on the node id, so other nodes keep theirs
+    // when membership changes
+    for (int v = 0; v < vnodes_; ++v) {
+      points_.push_back({hash(nodes_[n].id + "#" + std::to_string(v)), n});
+    }
+  }
+  std::sort(points_.begin(), points_.end());
+}
+
+size_t HashRing::owner_index(const std::string& key) const {
+  Point p{hash(key), 0};
+  auto it = std::lower_bound(points_.begin(), points_.end(), p);
+  if (it == points_.end()) it = points_.begin();
+  return it->node;
+}
+
+const ClusterNode& HashRing::owner(const std::string& key) const {
+  return nodes_[owner_index(key)];
+}
+
+const ClusterNode* HashRing::find(const std::string& id) const {
+  for (const auto& n : nodes_) {
+    if (n.id == id) return &n;
+  }
+  return nullptr;
+}
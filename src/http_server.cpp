@@ -1,12 +1,21 @@
 #include "http_server.hpp"
 #include "util.hpp"
+#include "near_cache.hpp"
+#include "compress.hpp"
 #include "cpp-httplib/httplib.h"
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 #include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
 #include <cstdlib>
+#include <strings.h>
+#include <functional>
 #include <thread>
+#include <unordered_map>
 
 // ---- CPU burn helper ----
 static void cpu_burn(int micros) {
@@ -25,43 +34,130 @@ static int get_cpu_burn() {
   return v ? std::atoi(v) : 0;
 }
 
-// Simple JSON builder
-static std::string json_kv(const std::string& k, const std::string& v) {
-  return std::string("{\"") + k + "\":\"" + v + "\"}";
-}
-
-// Minimal JSON parser for {"key":"..","value":".."}
-static std::pair<std::string, std::string> parse_json_kv(const std::string& body) {
-  auto kpos = body.find("\"key\"");
-  auto vpos = body.find("\"value\"");
-  if (kpos == std::string::npos || vpos == std::string::npos)
-    return {"", ""};
-  auto kstart = body.find('"', kpos + 5);
-  auto kend   = body.find('"', kstart + 1);
-  auto vstart = body.find('"', vpos + 7);
-  auto vend   = body.find('"', vstart + 1);
-  std::string key = body.substr(kstart + 1, kend - kstart - 1);
-  std::string val = body.substr(vstart + 1, vend - vstart - 1);
-  return {key, val};
-}
-
 // ---- Per-thread DB connection ----
 // Each OS thread gets its own DB object and connection.
 // This avoids sharing PGconn* across threads, which was causing protocol errors.
 namespace {
   thread_local DB tdb;
   thread_local bool tdb_connected = false;
+
+  // Per-thread L1 for hot keys. Hits are counted locally and published in
+  // batches so the L1 path never writes a shared cache line.
+  thread_local NearCache tl1;
+  thread_local bool tl1_ready = false;
+  thread_local uint64_t tl1_pending_hits = 0;
+  constexpr uint64_t NEAR_HITS_BATCH = 256;
+
+  // Keep-alive connections to peer nodes, one set per request thread
+  thread_local std::unordered_map<std::string, std::unique_ptr<httplib::Client>> tpeers;
+
+  // Marks a request that already took its one hop between nodes
+  const char* FORWARDED_HEADER = "X-KV-Forwarded";
+
+  // Response headers that describe the peer connection or body framing and
+  // are not passed back through a forward (Content-Type goes with the body)
+  bool hop_by_hop(const std::string& name) {
+    static const char* names[] = {"Connection", "Keep-Alive", "Transfer-Encoding",
+                                  "Content-Length", "Content-Type", "TE", "Trailer",
+                                  "Upgrade", "Proxy-Authenticate", "Proxy-Connection"};
+    for (const char* n : names) {
+      if (strcasecmp(name.c_str(), n) == 0) return true;
+    }
+    return false;
+  }
+
+  // Largest piece a blob download hands to the socket at once
+  constexpr size_t BLOB_CHUNK = 64 * 1024;
+
+  // X-Deadline-Ms values further ahead than this count as this far ahead
+  constexpr int64_t MAX_DEADLINE_MS = 24LL * 3600 * 1000;
 }
 
 // We keep dc_ in the KVServer object by reusing db_ in ctor to "test" DB,
 // but the actual per-thread connections are established lazily below.
 
 KVServer::KVServer(const ServerConfig& sc, const DBConfig& dc)
-    : sc_(sc) {
+    : sc_(sc), dc_(dc) {
   int burn = get_cpu_burn();
   std::cout << "CPU_BURN_US = " << burn << "\n";
 
-  cache_ = std::make_unique<LRUCache>(sc.cache_capacity);
+  blob_cache_ = std::make_unique<BlobCache>(std::max<size_t>(1, sc.blob_cache_cap));
+
+  if (sc.shard_cores > 0 || !sc.core_cpus.empty()) {
+    // Core partitions are plain LRUs; expiry, refresh and the near-cache's
+    // epochs live in LRUCache. Refuse rather than silently never expire.
+    if (sc.cache_ttl_ms > 0 || sc.refresh_after_ms > 0 || sc.stale_window_ms > 0) {
+      throw std::runtime_error("CACHE_TTL_MS, CACHE_REFRESH_MS and CACHE_STALE_MS are not "
+                               "supported with SHARD_CORES/CORE_CPUS");
+    }
+    if (sc.near_cache_slots > 0) {
+      throw std::runtime_error("NEAR_CACHE_SLOTS is not supported with SHARD_CORES/CORE_CPUS");
+    }
+    CoreExecutor::Options opts;
+    opts.capacity = sc.cache_capacity;
+    opts.cores = sc.shard_cores;
+    opts.cpus = sc.core_cpus;
+    opts.max_producers = sc.core_max_producers;
+    cores_ = std::make_unique<CoreExecutor>(opts);
+  } else {
+    cache_ = std::make_unique<LRUCache>(sc.cache_capacity);
+
+    CachePolicy policy;
+    policy.ttl = std::chrono::milliseconds(sc.cache_ttl_ms);
+    policy.refresh_after = std::chrono::milliseconds(sc.refresh_after_ms);
+    policy.stale_window = std::chrono::milliseconds(sc.stale_window_ms);
+    policy.refresh_min_hits = static_cast<uint32_t>(sc.refresh_min_hits);
+
+    // Refresh-ahead only makes sense when entries age at all
+    bool refresh = sc_.refresh_workers > 0 &&
+                   (sc.refresh_after_ms > 0 || (sc.cache_ttl_ms > 0 && sc.stale_window_ms > 0));
+    if (refresh) {
+      refresher_ = std::make_unique<Refresher>(*cache_, dc, sc.refresh_workers,
+                                               sc.cache_capacity);
+      cache_->set_policy(policy, [this](const std::string& key, uint64_t gen) {
+        refresher_->enqueue(key, gen);
+      });
+    } else {
+      cache_->set_policy(policy);
+    }
+  }
+
+  AdmissionController::Options ao;
+  ao.enabled = sc.admit_db_target_ms > 0;
+  ao.db.max = std::max(1, sc.admit_db_max);
+  ao.db.initial = ao.db.max;
+  ao.db.target = std::chrono::milliseconds(sc.admit_db_target_ms);
+  admission_ = std::make_unique<AdmissionController>(ao);
+
+  if (!sc.inval_channel.empty()) {
+    bus_ = std::make_unique<InvalidationBus>(
+      dc, sc.inval_channel, sc.inval_batch_ms,
+      [this](const std::string& key) {
+        inval_seq_++;
+        cache_erase(key);
+        blob_cache_->erase(key);
+      },
+      [this] {
+        inval_seq_++;
+        auto all = [](const std::string&) { return true; };
+        if (cores_) cores_->erase_if(all);
+        else cache_->erase_if(all);
+        blob_cache_->erase_if(all);
+      });
+  }
+
+  if (sc.counter_flush_ms > 0) {
+    counters_ = std::make_unique<CounterAggregator>(
+      dc, sc.counter_flush_ms, [this](const std::string& key, const DB::Row& row) {
+        cache_put(key, row.value, row.version);
+        if (bus_) bus_->publish(key);
+      });
+  }
+
+  if (!sc.cluster_file.empty()) {
+    std::string err;
+    if (!reload_ring(err)) throw std::runtime_error("Cluster config: " + err);
+  }
 
   // One-time startup check: ensure DB is reachable and table exists.
   // This uses the member db_ once, then all request handling uses thread-local DB.
@@ -69,6 +165,46 @@ KVServer::KVServer(const ServerConfig& sc, const DBConfig& dc)
     throw std::runtime_error("Failed to connect to database");
   }
   // db_ will be destroyed when KVServer is destroyed; we don't use it in handlers.
+
+  // Warm the cache from the last snapshot. Runs after the schema check
+  // above (validation needs updated_at) and after the ring is loaded, so
+  // keys this node no longer owns are left out.
+  if (!sc.snapshot_path.empty()) {
+    size_t sections = cores_ ? cores_->cores() : cache_->shards();
+    snapshot_ = std::make_unique<CacheSnapshot>(
+      dc, sc.snapshot_path, sections, [this](size_t section) {
+        return cores_ ? cores_->snapshot(static_cast<int>(section))
+                      : cache_->snapshot_shard(section);
+      });
+
+    // The invalidation listener flushes the whole cache on its first
+    // LISTEN, so restoring before that would warm the cache only for the
+    // flush to wipe it. Entries are validated against updated_at, so
+    // restoring after the flush can't bring back anything it dropped.
+    if (bus_ && !bus_->wait_listening(std::chrono::seconds(10))) {
+      std::cerr << "Snapshot: invalidation listener not up, skipping restore\n";
+    } else {
+      auto ring = std::atomic_load(&ring_);
+      int threads = sc.snapshot_load_threads > 0
+                      ? sc.snapshot_load_threads
+                      : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+      snapshot_->restore(
+        threads,
+        [this, ring](CacheSnapshot::Entries&& entries) {
+          if (ring) {
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const auto& e) {
+              return ring->owner(e.first).id != sc_.cluster_self;
+            }), entries.end());
+          }
+          if (cores_) return cores_->restore(entries);
+          size_t inserted = 0;
+          for (const auto& [key, value] : entries) inserted += cache_->restore(key, value);
+          return inserted;
+        },
+        [this] { return inval_seq_.load(); });
+    }
+    snapshot_->start_periodic(sc.snapshot_interval_s);
+  }
 }
 
 // Helper to get a per-thread DB connection using the same config
@@ -88,8 +224,223 @@ static DB* get_thread_db() {
   return &tdb;
 }
 
+std::optional<std::string> KVServer::cache_get(const std::string& key) {
+  if (cores_) {
+    auto v = cores_->get(key);
+    if (v) hits_++;
+    return v;
+  }
+
+  if (!tl1_ready) {
+    if (sc_.near_cache_slots > 0) {
+      tl1.init(sc_.near_cache_slots, sc_.near_cache_sample, sc_.near_cache_threshold);
+    }
+    tl1_ready = true;
+  }
+
+  // Per-thread near-cache first, then the shared in-memory cache
+  size_t hash = std::hash<std::string>{}(key);
+  if (tl1.enabled()) {
+    if (auto v = tl1.get(*cache_, key, hash)) {
+      if (++tl1_pending_hits == NEAR_HITS_BATCH) {
+        near_hits_ += tl1_pending_hits;
+        tl1_pending_hits = 0;
+      }
+      return v;
+    }
+    // Falling through to L2 is the slow path anyway; publish pending hits
+    if (tl1_pending_hits > 0) {
+      near_hits_ += tl1_pending_hits;
+      tl1_pending_hits = 0;
+    }
+  }
+
+  LRUCache::ReadStamp stamp;
+  auto v = cache_->get(key, &stamp);
+  if (v) {
+    hits_++;
+    if (tl1.enabled()) tl1.offer(key, hash, *v, stamp);
+  }
+  return v;
+}
+
+void KVServer::cache_put(const std::string& key, const std::string& value, uint64_t version) {
+  if (cores_) cores_->put(key, value, version);
+  else cache_->put(key, value, version);
+}
+
+void KVServer::cache_fill(const std::string& key, const std::string& value, uint64_t version,
+                          uint64_t seen) {
+  if (cores_) cores_->fill(key, value, version, inval_seq_, seen);
+  else cache_->fill(key, value, version, inval_seq_, seen);
+}
+
+void KVServer::cache_erase(const std::string& key) {
+  if (cores_) cores_->erase(key);
+  else cache_->erase(key);
+}
+
+void KVServer::blob_cache_put(const std::string& key, const std::string& value,
+                              uint64_t version, std::optional<uint64_t> seen) {
+  if (value.size() > sc_.blob_cache_max_value) {
+    // Not cached, but an older copy must not outlive this write
+    blob_cache_->erase(key);
+    return;
+  }
+  auto packed = std::make_shared<const std::string>(
+    compress::pack(value.data(), value.size(), sc_.blob_compress_min));
+  blob_cached_bytes_ += value.size();
+  blob_packed_bytes_ += packed->size();
+  if (seen) blob_cache_->fill(key, packed, version, inval_seq_, *seen);
+  else blob_cache_->put(key, packed, version);
+}
+
+size_t KVServer::cache_size() const {
+  return cores_ ? cores_->size() : cache_->size();
+}
+
+bool KVServer::reload_ring(std::string& err) {
+  std::lock_guard<std::mutex> g(ring_reload_mu_);
+
+  ClusterMembership m;
+  if (!load_membership(sc_.cluster_file, m, err)) return false;
+  auto ring = std::make_shared<const HashRing>(m);
+  if (!ring->find(sc_.cluster_self)) {
+    err = "node '" + sc_.cluster_self + "' not in " + sc_.cluster_file;
+    return false;
+  }
+
+  bool first = std::atomic_load(&ring_) == nullptr;
+  std::atomic_store(&ring_, ring);
+
+  // Keys that moved away are served by their new owner from now on; drop
+  // our copies so we can't serve them stale if ownership ever comes back.
+  if (!first) {
+    auto not_ours = [&](const std::string& key) {
+      return ring->owner(key).id != sc_.cluster_self;
+    };
+    size_t moved = cores_ ? cores_->erase_if(not_ours) : cache_->erase_if(not_ours);
+    moved += blob_cache_->erase_if(not_ours);
+    std::cout << "Cluster ring reloaded: " << ring->nodes().size() << " nodes, "
+              << moved << " cached keys moved away\n";
+  }
+  return true;
+}
+
+bool KVServer::route_remote(const std::string& key, const httplib::Request& req,
+                            httplib::Response& res, const std::string* body) {
+  auto ring = std::atomic_load(&ring_);
+  if (!ring) return false;
+
+  const ClusterNode& owner = ring->owner(key);
+  // A forwarded request is always served here: if rings disagree during a
+  // membership change we serve once rather than bounce between nodes.
+  if (owner.id == sc_.cluster_self || req.has_header(FORWARDED_HEADER)) return false;
+
+  std::string base = owner.host + ":" + std::to_string(owner.port);
+  if (sc_.cluster_redirect) {
+    redirected_++;
+    res.status = 307;
+    res.set_header("Location", "http://" + base + req.target);
+    return true;
+  }
+
+  auto& cli = tpeers[base];
+  if (!cli) {
+    cli = std::make_unique<httplib::Client>(owner.host, owner.port);
+    cli->set_path_encode(false);  // req.target is already encoded
+    cli->set_connection_timeout(2, 0);
+    cli->set_read_timeout(10, 0);
+    cli->set_keep_alive(true);
+  }
+
+  httplib::Request fwd;
+  fwd.method = req.method;
+  fwd.path = req.target;
+  fwd.body = body ? *body : req.body;
+  fwd.set_header(FORWARDED_HEADER, sc_.cluster_self);
+  for (const char* h : {"Content-Type", "X-Deadline-Ms"}) {
+    if (req.has_header(h)) fwd.set_header(h, req.get_header_value(h));
+  }
+
+  auto r = cli->send(fwd);
+  if (!r) {
+    forward_errors_++;
+    res.status = 502;
+    res.set_content("{\"error\":\"owner " + owner.id + " unreachable\"}", "application/json");
+    return true;
+  }
+
+  forwarded_++;
+  res.status = r->status;
+  // Keeps the owner's Retry-After and X-* headers (e.g. on a 503 shed)
+  for (const auto& [name, value] : r->headers) {
+    if (!hop_by_hop(name)) res.headers.emplace(name, value);
+  }
+  res.set_content(r->body, r->get_header_value("Content-Type", "application/json"));
+  return true;
+}
+
+AdmissionController::Clock::time_point KVServer::deadline_of(const httplib::Request& req) {
+  using Clock = AdmissionController::Clock;
+  if (!req.has_header("X-Deadline-Ms")) return Clock::time_point::max();
+
+  // Malformed values are ignored rather than read as the epoch
+  std::string header = req.get_header_value("X-Deadline-Ms");
+  char* end = nullptr;
+  errno = 0;
+  int64_t deadline_ms = std::strtoll(header.c_str(), &end, 10);
+  if (header.empty() || *end != '\0' || errno == ERANGE || deadline_ms < 0) {
+    return Clock::time_point::max();
+  }
+
+  // Clamped so a far-future deadline can't overflow the clock
+  int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  int64_t remaining_ms = std::min<int64_t>(deadline_ms - now_ms, MAX_DEADLINE_MS);
+  return Clock::now() + std::chrono::milliseconds(remaining_ms);
+}
+
+void KVServer::stop() {
+  // Returns once listen() is running, so a signal during startup still
+  // stops the server instead of being lost
+  srv_.wait_until_ready();
+  srv_.stop();
+}
+
 bool KVServer::start() {
-  httplib::Server srv;
+  httplib::Server& srv = srv_;
+
+  // Bounded accept queue: once every pool thread is busy and this many
+  // connections wait, new ones are closed at once instead of queueing for
+  // seconds behind a slow DB.
+  if (sc_.admit_max_queue > 0) {
+    size_t max_queue = sc_.admit_max_queue;
+    srv.new_task_queue = [max_queue] {
+      return new httplib::ThreadPool(CPPHTTPLIB_THREAD_POOL_COUNT, max_queue);
+    };
+  }
+
+  // Requests whose client-supplied deadline already passed (e.g. while
+  // queued) are dropped before any work is done.
+  srv.set_pre_routing_handler([&](const httplib::Request& req, httplib::Response& res) {
+    if (deadline_of(req) <= AdmissionController::Clock::now()) {
+      admission_->count_expired();
+      util::deadline_exceeded(res);
+      return httplib::Server::HandlerResponse::Handled;
+    }
+    return httplib::Server::HandlerResponse::Unhandled;
+  });
+
+  // Clients that send "Expect: 100-continue" learn about an oversized
+  // blob before uploading it
+  srv.set_expect_100_continue_handler([&](const httplib::Request& req, httplib::Response& res) {
+    if (req.get_header_value_u64("Content-Length") > sc_.blob_max_bytes) {
+      res.status = 413;
+      return 413;
+    }
+    return 100;
+  });
 
   int cpu_burn_us = get_cpu_burn();
   std::cout << "Using CPU burn: " << cpu_burn_us << " microseconds\n";
@@ -98,25 +449,38 @@ bool KVServer::start() {
   srv.Post("/create", [&](const httplib::Request& req, httplib::Response& res) {
     cpu_burn(cpu_burn_us);
 
-    auto [key, value] = parse_json_kv(req.body);
+    auto [key, value] = util::parse_json_kv(req.body);
     if (key.empty() || value.empty()) {
       util::bad(res, "Invalid JSON body");
       return;
     }
+    if (route_remote(key, req, res)) return;
+
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
 
     DB* db = get_thread_db();
     if (!db) {
+      permit.fail();
       util::server_err(res);
       return;
     }
 
-    if (!db->upsert(key, value)) {
+    uint64_t version = 0;
+    bool stored = db->upsert(key, value, &version);
+    if (!stored) permit.fail();
+    permit.release();
+    if (!stored) {
       util::server_err(res);
       return;
     }
 
-    cache_->put(key, value);
-    util::ok(res, json_kv("status", "ok"));
+    cache_put(key, value, version);
+    if (bus_) bus_->publish(key);
+    util::ok(res, util::json_kv("status", "ok"));
   });
 
   // GET /read?key=...
@@ -128,25 +492,36 @@ bool KVServer::start() {
       return;
     }
     auto key = req.get_param_value("key");
+    if (route_remote(key, req, res)) return;
 
     // First hit the in-memory cache
-    if (auto v = cache_->get(key)) {
-      hits_++;
-      util::ok(res, json_kv("value", *v));
+    if (auto v = cache_get(key)) {
+      util::ok(res, util::json_kv("value", *v));
       return;
     }
 
     misses_++;
 
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
+
     DB* db = get_thread_db();
     if (!db) {
+      permit.fail();
       util::server_err(res);
       return;
     }
 
-    if (auto vdb = db->get(key)) {
-      cache_->put(key, *vdb);
-      util::ok(res, json_kv("value", *vdb));
+    uint64_t seq = inval_seq_.load();
+    uint64_t version = 0;
+    auto vdb = db->get(key, &version);
+    permit.release();
+    if (vdb) {
+      cache_fill(key, *vdb, version, seq);
+      util::ok(res, util::json_kv("value", *vdb));
       return;
     }
 
@@ -162,38 +537,505 @@ bool KVServer::start() {
       return;
     }
     auto key = req.get_param_value("key");
+    if (route_remote(key, req, res)) return;
+
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
 
     DB* db = get_thread_db();
     if (!db) {
+      permit.fail();
       util::server_err(res);
       return;
     }
 
-    if (!db->erase(key)) {
+    bool erased = db->erase(key);
+    if (!erased) permit.fail();
+    permit.release();
+    if (!erased) {
       util::server_err(res);
       return;
     }
 
-    cache_->erase(key);
-    util::ok(res, json_kv("status", "deleted"));
+    cache_erase(key);
+    if (bus_) bus_->publish(key);
+    util::ok(res, util::json_kv("status", "deleted"));
+  });
+
+  // ---- Atomic operations ----
+  // Each runs as one SQL statement; the row it returns is what gets cached
+  // and sent back, so concurrent clients never lose updates.
+  auto row_json = [](const DB::Row& row) {
+    return "{\"value\":\"" + row.value + "\",\"version\":" + std::to_string(row.version) + "}";
+  };
+
+  auto run_atomic = [&](const std::string& key, const httplib::Request& req,
+                        httplib::Response& res, const std::function<DB::OpResult(DB&)>& op) {
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
+
+    DB* db = get_thread_db();
+    if (!db) {
+      permit.fail();
+      util::server_err(res);
+      return;
+    }
+
+    DB::OpResult r = op(*db);
+    if (r.status == DB::OpStatus::Error) permit.fail();
+    permit.release();
+    atomic_ops_++;
+
+    switch (r.status) {
+      case DB::OpStatus::Ok:
+        cache_put(key, r.row.value, r.row.version);
+        if (bus_) bus_->publish(key);
+        util::ok(res, row_json(r.row));
+        break;
+      case DB::OpStatus::Conflict:
+        cas_conflicts_++;
+        util::conflict(res, "{\"error\":\"version mismatch\",\"value\":\"" + r.row.value +
+                            "\",\"version\":" + std::to_string(r.row.version) + "}");
+        break;
+      case DB::OpStatus::NotFound:
+        util::not_found(res);
+        break;
+      case DB::OpStatus::NotInteger:
+        util::bad(res, "value is not an integer");
+        break;
+      case DB::OpStatus::Error:
+        util::server_err(res);
+        break;
+    }
+  };
+
+  // POST /incr, /decr  {"key":"..","by":N,"defer":true}  (by defaults to 1)
+  auto counter = [&](int sign) {
+    return [&, sign](const httplib::Request& req, httplib::Response& res) {
+      cpu_burn(cpu_burn_us);
+
+      auto key = util::json_field(req.body, "key");
+      auto by = util::json_field(req.body, "by");
+      if (!key || key->empty()) {
+        util::bad(res, "Invalid JSON body");
+        return;
+      }
+      int64_t delta = 1;
+      if (by) {
+        char* end = nullptr;
+        errno = 0;
+        delta = std::strtoll(by->c_str(), &end, 10);
+        if (by->empty() || *end != '\0' || errno == ERANGE || delta == INT64_MIN) {
+          util::bad(res, "Invalid 'by'");
+          return;
+        }
+      }
+      delta *= sign;
+      if (route_remote(*key, req, res)) return;
+
+      if (counters_ && util::json_field(req.body, "defer") == std::optional<std::string>("true")) {
+        counters_->add(*key, delta);
+        res.status = 202;
+        res.set_content(util::json_kv("status", "queued"), "application/json");
+        return;
+      }
+      run_atomic(*key, req, res, [&](DB& db) { return db.incr(*key, delta); });
+    };
+  };
+  srv.Post("/incr", counter(1));
+  srv.Post("/decr", counter(-1));
+
+  // POST /append  {"key":"..","value":".."}
+  srv.Post("/append", [&](const httplib::Request& req, httplib::Response& res) {
+    cpu_burn(cpu_burn_us);
+
+    auto key = util::json_field(req.body, "key");
+    auto value = util::json_field(req.body, "value");
+    if (!key || key->empty() || !value) {
+      util::bad(res, "Invalid JSON body");
+      return;
+    }
+    if (route_remote(*key, req, res)) return;
+    run_atomic(*key, req, res, [&](DB& db) { return db.append(*key, *value); });
+  });
+
+  // POST /cas  {"key":"..","value":"..","version":N}  (version 0 = create)
+  srv.Post("/cas", [&](const httplib::Request& req, httplib::Response& res) {
+    cpu_burn(cpu_burn_us);
+
+    auto key = util::json_field(req.body, "key");
+    auto value = util::json_field(req.body, "value");
+    auto version = util::json_field(req.body, "version");
+    if (!key || key->empty() || !value || !version || version->empty() ||
+        version->find_first_not_of("0123456789") != std::string::npos) {
+      util::bad(res, "Invalid JSON body");
+      return;
+    }
+    uint64_t expected = std::strtoull(version->c_str(), nullptr, 10);
+    if (route_remote(*key, req, res)) return;
+    run_atomic(*key, req, res, [&](DB& db) { return db.cas(*key, *value, expected); });
+  });
+
+  // GET /gets?key=...  value and version straight from the DB, for CAS
+  srv.Get("/gets", [&](const httplib::Request& req, httplib::Response& res) {
+    cpu_burn(cpu_burn_us);
+
+    if (!req.has_param("key")) {
+      util::bad(res, "Missing key parameter");
+      return;
+    }
+    auto key = req.get_param_value("key");
+    if (route_remote(key, req, res)) return;
+
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
+
+    DB* db = get_thread_db();
+    if (!db) {
+      permit.fail();
+      util::server_err(res);
+      return;
+    }
+
+    uint64_t seq = inval_seq_.load();
+    DB::Row row;
+    auto v = db->get(key, &row.version);
+    permit.release();
+    if (!v) {
+      util::not_found(res);
+      return;
+    }
+    row.value = std::move(*v);
+    cache_fill(key, row.value, row.version, seq);
+    util::ok(res, row_json(row));
+  });
+
+  // ---- Binary values ----
+  // The body is the value, as application/octet-stream; nothing is JSON
+  // encoded. Uploads are read through a content reader straight into one
+  // buffer, downloads are streamed from a shared buffer by a content
+  // provider instead of being copied into the response.
+  // PUT /blob?key=...
+  srv.Put("/blob", [&](const httplib::Request& req, httplib::Response& res,
+                       const httplib::ContentReader& content_reader) {
+    if (!req.has_param("key")) {
+      util::bad(res, "Missing key parameter");
+      return;
+    }
+    auto key = req.get_param_value("key");
+
+    size_t declared = req.get_header_value_u64("Content-Length");
+    bool too_large = declared > sc_.blob_max_bytes;
+    std::string body;
+    if (!too_large) {
+      body.reserve(declared);
+      content_reader([&](const char* data, size_t len) {
+        if (body.size() + len > sc_.blob_max_bytes) {
+          too_large = true;
+          return false;
+        }
+        body.append(data, len);
+        return true;
+      });
+    }
+    if (too_large) {
+      res.status = 413;
+      res.set_content("{\"error\":\"value too large\"}", "application/json");
+      return;
+    }
+    if (route_remote(key, req, res, &body)) return;
+
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
+
+    DB* db = get_thread_db();
+    if (!db) {
+      permit.fail();
+      util::server_err(res);
+      return;
+    }
+
+    uint64_t version = 0;
+    bool stored = db->put_blob(key, body.data(), body.size(), &version);
+    if (!stored) permit.fail();
+    permit.release();
+    if (!stored) {
+      util::server_err(res);
+      return;
+    }
+
+    blob_cache_put(key, body, version);
+    if (bus_) bus_->publish(key);
+    util::ok(res, util::json_kv("status", "ok"));
+  });
+
+  // GET /blob?key=...
+  srv.Get("/blob", [&](const httplib::Request& req, httplib::Response& res) {
+    if (!req.has_param("key")) {
+      util::bad(res, "Missing key parameter");
+      return;
+    }
+    auto key = req.get_param_value("key");
+    if (route_remote(key, req, res)) return;
+
+    // Raw cached entries are served from the cached buffer itself, past
+    // their tag byte
+    std::shared_ptr<const std::string> buf;
+    size_t skip = 0;
+    if (auto packed = blob_cache_->get(key)) {
+      if (compress::is_raw(**packed)) {
+        buf = std::move(*packed);
+        skip = compress::RAW_OFFSET;
+      } else {
+        auto raw = std::make_shared<std::string>();
+        if (compress::unpack(**packed, *raw)) buf = std::move(raw);
+        else blob_cache_->erase(key);
+      }
+    }
+
+    if (buf) {
+      blob_hits_++;
+    } else {
+      blob_misses_++;
+
+      auto permit = admission_->acquire_db(deadline_of(req));
+      if (!permit) {
+        util::unavailable(res, sc_.retry_after_s);
+        return;
+      }
+
+      DB* db = get_thread_db();
+      if (!db) {
+        permit.fail();
+        util::server_err(res);
+        return;
+      }
+
+      uint64_t seq = inval_seq_.load();
+      uint64_t version = 0;
+      auto v = db->get_blob(key, &version);
+      permit.release();
+      if (!v) {
+        util::not_found(res);
+        return;
+      }
+      blob_cache_put(key, *v, version, seq);
+      buf = std::make_shared<const std::string>(std::move(*v));
+    }
+
+    res.status = 200;
+    res.set_content_provider(
+      buf->size() - skip, "application/octet-stream",
+      [buf, skip](size_t offset, size_t length, httplib::DataSink& sink) {
+        return sink.write(buf->data() + skip + offset, std::min(length, BLOB_CHUNK));
+      });
+  });
+
+  // DELETE /blob?key=...
+  srv.Delete("/blob", [&](const httplib::Request& req, httplib::Response& res) {
+    if (!req.has_param("key")) {
+      util::bad(res, "Missing key parameter");
+      return;
+    }
+    auto key = req.get_param_value("key");
+    if (route_remote(key, req, res)) return;
+
+    auto permit = admission_->acquire_db(deadline_of(req));
+    if (!permit) {
+      util::unavailable(res, sc_.retry_after_s);
+      return;
+    }
+
+    DB* db = get_thread_db();
+    if (!db) {
+      permit.fail();
+      util::server_err(res);
+      return;
+    }
+
+    bool erased = db->erase_blob(key);
+    if (!erased) permit.fail();
+    permit.release();
+    if (!erased) {
+      util::server_err(res);
+      return;
+    }
+
+    blob_cache_->erase(key);
+    if (bus_) bus_->publish(key);
+    util::ok(res, util::json_kv("status", "deleted"));
   });
 
   // GET /metrics
   srv.Get("/metrics", [&](const httplib::Request&, httplib::Response& res) {
+    InvalidationBus::Counters ic{};
+    if (bus_) ic = bus_->counters();
+    CacheSnapshot::Counters sc{};
+    if (snapshot_) sc = snapshot_->counters();
+    CounterAggregator::Counters cc{};
+    if (counters_) cc = counters_->counters();
     std::ostringstream ss;
     ss << "{"
-       << "\"cache_size\":" << cache_->size() << ","
-       << "\"cache_hits\":" << hits_.load() << ","
-       << "\"cache_misses\":" << misses_.load()
+       << "\"cache_size\":" << cache_size() << ","
+       << "\"cache_hits\":" << hits_.load() + near_hits_.load() << ","
+       << "\"cache_misses\":" << misses_.load() << ","
+       << "\"near_cache_hits\":" << near_hits_.load() << ","
+       << "\"cache_expired\":" << (cache_ ? cache_->expired() : 0) << ","
+       << "\"cache_stale_hits\":" << (cache_ ? cache_->stale_hits() : 0) << ","
+       << "\"refresh_requests\":" << (cache_ ? cache_->refreshes() : 0) << ","
+       << "\"refresh_completed\":" << (refresher_ ? refresher_->completed() : 0) << ","
+       << "\"refresh_failed\":" << (refresher_ ? refresher_->failed() : 0) << ","
+       << "\"refresh_dropped\":" << (refresher_ ? refresher_->dropped() : 0) << ","
+       << "\"core_overflow_ops\":" << (cores_ ? cores_->overflow_ops() : 0) << ","
+       << "\"cluster_forwarded\":" << forwarded_.load() << ","
+       << "\"cluster_redirected\":" << redirected_.load() << ","
+       << "\"cluster_forward_errors\":" << forward_errors_.load() << ","
+       << "\"inval_published_keys\":" << ic.published_keys << ","
+       << "\"inval_published_batches\":" << ic.published_batches << ","
+       << "\"inval_publish_errors\":" << ic.publish_errors << ","
+       << "\"inval_received_batches\":" << ic.received_batches << ","
+       << "\"inval_applied_keys\":" << ic.applied_keys << ","
+       << "\"inval_lag_ms_last\":" << ic.lag_ms_last << ","
+       << "\"inval_lag_ms_max\":" << ic.lag_ms_max << ","
+       << "\"inval_lag_ms_avg\":"
+       << (ic.received_batches ? ic.lag_ms_sum / ic.received_batches : 0) << ","
+       << "\"inval_reconnects\":" << ic.reconnects << ","
+       << "\"inval_full_flushes\":" << ic.full_flushes << ","
+       << "\"admit_db_limit\":" << admission_->db().limit() << ","
+       << "\"admit_db_inflight\":" << admission_->db().inflight() << ","
+       << "\"admit_db_latency_us\":" << admission_->db().latency().count() << ","
+       << "\"admit_shed\":" << admission_->shed() << ","
+       << "\"admit_shed_deadline\":" << admission_->shed_deadline() << ","
+       << "\"admit_expired\":" << admission_->expired() << ","
+       << "\"db_ops\":" << admission_->db_ops() << ","
+       << "\"db_time_us\":" << admission_->db_time_us() << ","
+       << "\"atomic_ops\":" << atomic_ops_.load() << ","
+       << "\"cas_conflicts\":" << cas_conflicts_.load() << ","
+       << "\"counter_deferred\":" << cc.deferred << ","
+       << "\"counter_flushes\":" << cc.flushes << ","
+       << "\"counter_flushed_keys\":" << cc.flushed_keys << ","
+       << "\"counter_flush_errors\":" << cc.flush_errors << ","
+       << "\"counter_dropped\":" << cc.dropped << ","
+       << "\"blob_cache_size\":" << blob_cache_->size() << ","
+       << "\"blob_cache_hits\":" << blob_hits_.load() << ","
+       << "\"blob_cache_misses\":" << blob_misses_.load() << ","
+       << "\"blob_cached_bytes\":" << blob_cached_bytes_.load() << ","
+       << "\"blob_packed_bytes\":" << blob_packed_bytes_.load() << ","
+       << "\"snapshot_writes\":" << sc.writes << ","
+       << "\"snapshot_write_errors\":" << sc.write_errors << ","
+       << "\"snapshot_last_entries\":" << sc.last_write_entries << ","
+       << "\"snapshot_last_write_ms\":" << sc.last_write_ms << ","
+       << "\"snapshot_restored\":" << sc.restored << ","
+       << "\"snapshot_dropped_stale\":" << sc.dropped_stale << ","
+       << "\"snapshot_dropped_corrupt\":" << sc.dropped_corrupt << ","
+       << "\"snapshot_restore_ms\":" << sc.restore_ms << ","
+       << "\"startup_ms\":" << startup_ms_.load() << ","
+       << "\"process_cpu_us\":" << util::process_cpu_us()
        << "}";
     util::ok(res, ss.str());
   });
 
+  // GET /cluster
+  srv.Get("/cluster", [&](const httplib::Request&, httplib::Response& res) {
+    auto ring = std::atomic_load(&ring_);
+    if (!ring) {
+      util::not_found(res);
+      return;
+    }
+    std::ostringstream ss;
+    ss << "{\"self\":\"" << sc_.cluster_self << "\","
+       << "\"mode\":\"" << (sc_.cluster_redirect ? "redirect" : "forward") << "\","
+       << "\"vnodes\":" << ring->vnodes() << ",\"nodes\":[";
+    for (size_t i = 0; i < ring->nodes().size(); ++i) {
+      const auto& n = ring->nodes()[i];
+      ss << (i ? "," : "") << "{\"id\":\"" << n.id << "\",\"addr\":\""
+         << n.host << ":" << n.port << "\"}";
+    }
+    ss << "]}";
+    util::ok(res, ss.str());
+  });
+
+  // POST /cluster/reload: re-read the membership file
+  srv.Post("/cluster/reload", [&](const httplib::Request&, httplib::Response& res) {
+    if (sc_.cluster_file.empty()) {
+      util::bad(res, "cluster mode disabled");
+      return;
+    }
+    std::string err;
+    if (!reload_ring(err)) {
+      util::bad(res, err);
+      return;
+    }
+    util::ok(res, util::json_kv("status", "reloaded"));
+  });
+
   std::cout << "=========================================\n";
   std::cout << "KV Server running at http://" << sc_.host << ":" << sc_.port
             << " with " << sc_.threads << " threads (configured)\n";
   std::cout << "Cache capacity: " << sc_.cache_capacity << "\n";
+  if (cores_) {
+    std::cout << "Shard-per-core: " << cores_->cores() << " core threads";
+    if (!sc_.core_cpus.empty()) {
+      std::cout << " pinned to CPUs";
+      for (int c : sc_.core_cpus) std::cout << " " << c;
+    }
+    std::cout << "\n";
+  }
+  if (auto ring = std::atomic_load(&ring_)) {
+    std::cout << "Cluster node '" << sc_.cluster_self << "' of " << ring->nodes().size()
+              << " (" << ring->vnodes() << " vnodes each, "
+              << (sc_.cluster_redirect ? "redirect" : "forward") << " mode)\n";
+  }
+  if (admission_->enabled()) {
+    std::cout << "Admission control: DB target " << sc_.admit_db_target_ms
+              << " ms, DB limit <= " << sc_.admit_db_max << "\n";
+  }
+  if (bus_) {
+    std::cout << "Invalidation bus: channel '" << sc_.inval_channel << "', batch "
+              << sc_.inval_batch_ms << " ms\n";
+  }
+  if (sc_.near_cache_slots > 0) {
+    std::cout << "Near-cache: " << sc_.near_cache_slots << " slots/thread\n";
+  }
+  if (refresher_) {
+    std::cout << "Refresh-ahead: after " << sc_.refresh_after_ms << " ms, ttl "
+              << sc_.cache_ttl_ms << " ms, stale window " << sc_.stale_window_ms
+              << " ms, " << sc_.refresh_workers << " workers\n";
+  }
+  if (counters_) {
+    std::cout << "Deferred counters: flushed every " << sc_.counter_flush_ms << " ms\n";
+  }
+  if (snapshot_) {
+    std::cout << "Cache snapshot: " << sc_.snapshot_path << ", written on shutdown";
+    if (sc_.snapshot_interval_s > 0) std::cout << " and every " << sc_.snapshot_interval_s << " s";
+    std::cout << "\n";
+  }
   std::cout << "=========================================\n";
 
-  return srv.listen(sc_.host.c_str(), sc_.port);
+  if (!srv.bind_to_port(sc_.host.c_str(), sc_.port)) return false;
+  startup_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - created_at_).count();
+  std::cout << "Listening after " << startup_ms_.load() << " ms\n";
+  bool ok = srv.listen_after_bind();
+
+  // listen() returns once in-flight requests finished, so this final
+  // snapshot sees every write that was acknowledged
+  if (counters_) counters_->flush();
+  if (snapshot_ && snapshot_->write()) {
+    std::cout << "Cache snapshot written: " << snapshot_->counters().last_write_entries
+              << " entries\n";
+  }
+  return ok;
 }
@@ -0,0 +1,262 @@
+#include "invalidation_bus.hpp"
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <poll.h>
+#include <random>
+#include <unistd.h>
+
+// Payload: "<origin> <unix ms the oldest key was queued>\n" followed by
+// either "*" (flush everything) or keys encoded as "<len>:<key>" back to
+// back. NOTIFY payloads must stay below 8000 bytes, so batches are split.
+static constexpr size_t MAX_PAYLOAD = 7500;
+static constexpr size_t MAX_PENDING = 100000;
+
+static uint64_t now_unix_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+InvalidationBus::InvalidationBus(const DBConfig& dc, const std::string& channel, int batch_ms,
+                                 ApplyFn apply, FlushFn flush)
+    : dc_(dc), channel_(channel), batch_ms_(batch_ms > 0 ? batch_ms : 1),
+      apply_(std::move(apply)), flush_(std::move(flush)) {
+  std::random_device rd;
+  origin_ = std::to_string(getpid()) + "-" + std::to_string(rd());
+
+  publisher_ = std::thread([this] { publisher_loop(); });
+  listener_ = std::thread([this] { listener_loop(); });
+}
+
+InvalidationBus::~InvalidationBus() {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    stop_.store(true);
+  }
+  cv_.notify_all();
+  publisher_.join();
+  listener_.join();
+}
+
+void InvalidationBus::publish(const std::string& key) {
+  std::lock_guard<std::mutex> g(mu_);
+  if (flush_all_pending_) return;
+  if (pending_.empty()) pending_since_ms_ = now_unix_ms();
+  if (pending_.size() >= MAX_PENDING) {
+    // Peers are far behind anyway; one flush is cheaper than 100k keys
+    pending_.clear();
+    flush_all_pending_ = true;
+    return;
+  }
+  pending_.push_back(key);
+}
+
+bool InvalidationBus::wait_listening(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lk(mu_);
+  return listening_cv_.wait_for(lk, timeout, [this] { return listening_; });
+}
+
+InvalidationBus::Counters InvalidationBus::counters() const {
+  return {published_keys_.load(), published_batches_.load(), publish_errors_.load(),
+          received_batches_.load(), applied_keys_.load(),
+          lag_ms_last_.load(), lag_ms_max_.load(), lag_ms_sum_.load(),
+          reconnects_.load(), full_flushes_.load()};
+}
+
+bool InvalidationBus::send(PGconn* conn, const std::string& payload) {
+  const char* sql = "SELECT pg_notify($1, $2);";
+  const char* params[2] = { channel_.c_str(), payload.c_str() };
+  PGresult* res = PQexecParams(conn, sql, 2, nullptr, params, nullptr, nullptr, 0);
+  bool ok = PQresultStatus(res) == PGRES_TUPLES_OK;
+  if (!ok) std::cerr << "Invalidation publish failed: " << PQerrorMessage(conn);
+  PQclear(res);
+  return ok;
+}
+
+void InvalidationBus::publisher_loop() {
+  PGconn* conn = nullptr;
+  std::vector<std::string> batch;
+
+  while (true) {
+    bool all;
+    uint64_t since;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait_for(lk, std::chrono::milliseconds(batch_ms_), [this] { return stop_.load(); });
+      if (stop_ && pending_.empty() && !flush_all_pending_) break;
+      batch.swap(pending_);
+      all = flush_all_pending_;
+      flush_all_pending_ = false;
+      since = pending_since_ms_;
+    }
+    if (batch.empty() && !all) continue;
+
+    if (!conn || PQstatus(conn) != CONNECTION_OK) {
+      if (conn) PQfinish(conn);
+      conn = PQconnectdb(DB::conninfo(dc_).c_str());
+      if (PQstatus(conn) != CONNECTION_OK) {
+        std::cerr << "Invalidation publisher connect failed: " << PQerrorMessage(conn);
+        PQfinish(conn);
+        conn = nullptr;
+      }
+    }
+
+    // Stamped with when the oldest key was queued, so receivers' lag
+    // includes batching and publish retries
+    std::string header = origin_ + " " + std::to_string(since) + "\n";
+    std::vector<std::string> payloads;
+    if (all) {
+      payloads.push_back(header + "*");
+    } else {
+      std::string p = header;
+      for (const auto& key : batch) {
+        std::string entry = std::to_string(key.size()) + ":" + key;
+        if (header.size() + entry.size() > MAX_PAYLOAD) {
+          // A key that can't fit in any payload: make peers drop everything
+          payloads.assign(1, header + "*");
+          p = header;
+          break;
+        }
+        if (p.size() + entry.size() > MAX_PAYLOAD) {
+          payloads.push_back(std::move(p));
+          p = header;
+        }
+        p += entry;
+      }
+      if (p.size() > header.size()) payloads.push_back(std::move(p));
+    }
+
+    bool ok = conn != nullptr;
+    for (size_t i = 0; ok && i < payloads.size(); ++i) {
+      ok = send(conn, payloads[i]);
+      if (ok) published_batches_++;
+    }
+
+    if (ok) {
+      published_keys_ += batch.size();
+    } else {
+      // We can't tell which keys peers missed; ask them to flush instead
+      publish_errors_++;
+      std::unique_lock<std::mutex> lk(mu_);
+      pending_.clear();
+      flush_all_pending_ = true;
+      pending_since_ms_ = since;
+      // Back off without holding up publish(); stop() cuts the wait short
+      cv_.wait_for(lk, std::chrono::milliseconds(100), [this] { return stop_.load(); });
+    }
+    batch.clear();
+    if (!ok && stop_) break;
+  }
+
+  if (conn) PQfinish(conn);
+}
+
+PGconn* InvalidationBus::connect_listener() {
+  // TCP keepalives so a silently dead connection is noticed and the
+  // cache gets flushed, rather than waiting forever on a dead socket
+  std::string info = DB::conninfo(dc_) +
+    " keepalives=1 keepalives_idle=10 keepalives_interval=5 keepalives_count=3";
+  PGconn* conn = PQconnectdb(info.c_str());
+  if (PQstatus(conn) != CONNECTION_OK) {
+    std::cerr << "Invalidation listener connect failed: " << PQerrorMessage(conn);
+    PQfinish(conn);
+    return nullptr;
+  }
+
+  char* ident = PQescapeIdentifier(conn, channel_.c_str(), channel_.size());
+  std::string sql = std::string("LISTEN ") + ident + ";";
+  PQfreemem(ident);
+
+  PGresult* res = PQexec(conn, sql.c_str());
+  bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+  if (!ok) std::cerr << "LISTEN failed: " << PQerrorMessage(conn);
+  PQclear(res);
+  if (!ok) {
+    PQfinish(conn);
+    return nullptr;
+  }
+  return conn;
+}
+
+void InvalidationBus::listener_loop() {
+  PGconn* conn = nullptr;
+  bool connected_before = false;
+
+  while (!stop_.load()) {
+    if (!conn) {
+      conn = connect_listener();
+      if (!conn) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        continue;
+      }
+      // Anything published while we weren't listening is lost; that
+      // includes the window before the first LISTEN succeeded.
+      if (connected_before) reconnects_++;
+      full_flushes_++;
+      flush_();
+      if (!connected_before) {
+        {
+          std::lock_guard<std::mutex> g(mu_);
+          listening_ = true;
+        }
+        listening_cv_.notify_all();
+      }
+      connected_before = true;
+    }
+
+    pollfd pfd{PQsocket(conn), POLLIN, 0};
+    int rc = poll(&pfd, 1, 200);  // bounded so stop_ is noticed
+    bool broken = rc < 0 && errno != EINTR;
+    if (rc > 0 && !PQconsumeInput(conn)) broken = true;
+
+    PGnotify* n;
+    while (!broken && (n = PQnotifies(conn)) != nullptr) {
+      handle(n->extra);
+      PQfreemem(n);
+    }
+
+    if (broken || PQstatus(conn) != CONNECTION_OK) {
+      std::cerr << "Invalidation listener lost connection: " << PQerrorMessage(conn);
+      PQfinish(conn);
+      conn = nullptr;
+    }
+  }
+
+  if (conn) PQfinish(conn);
+}
+
+void InvalidationBus::handle(const std::string& payload) {
+  auto nl = payload.find('\n');
+  auto sp = payload.find(' ');
+  if (nl == std::string::npos || sp == std::string::npos || sp > nl) return;
+
+  // Our own writes already updated the local cache
+  if (payload.compare(0, sp, origin_) == 0 && sp == origin_.size()) return;
+
+  received_batches_++;
+  uint64_t sent = std::strtoull(payload.c_str() + sp + 1, nullptr, 10);
+  uint64_t now = now_unix_ms();
+  uint64_t lag = now > sent ? now - sent : 0;  // clocks of different hosts may skew
+  lag_ms_last_.store(lag);
+  lag_ms_sum_ += lag;
+  uint64_t prev = lag_ms_max_.load();
+  while (lag > prev && !lag_ms_max_.compare_exchange_weak(prev, lag)) {}
+
+  size_t pos = nl + 1;
+  if (payload.compare(pos, std::string::npos, "*") == 0) {
+    full_flushes_++;
+    flush_();
+    return;
+  }
+
+  while (pos < payload.size()) {
+    auto colon = payload.find(':', pos);
+    if (colon == std::string::npos) break;
+    size_t len = std::strtoull(payload.c_str() + pos, nullptr, 10);
+    if (colon + 1 + len > payload.size()) break;
+    apply_(payload.substr(colon + 1, len));
+    applied_keys_++;
+    pos = colon + 1 + len;
+  }
+}
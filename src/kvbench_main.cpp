@@ -0,0 +1,427 @@
+#include "lru_cache.hpp"
+#include "db.hpp"
+#include "util.hpp"
+#include "cpp-httplib/httplib.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// Allocation counting
+// ============================================================================
+// Every heap allocation in the process goes through these; the counter is
+// per thread so multi-threaded benchmarks don't contend on it.
+namespace {
+  thread_local uint64_t t_allocs = 0;
+}
+
+void* operator new(std::size_t n) {
+  t_allocs++;
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n) {
+  t_allocs++;
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+
+// GCC can't see that the operator new above is malloc-based
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+// ============================================================================
+// Configuration
+// ============================================================================
+struct BenchConfig {
+  int max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  uint64_t ops = 200000;       // per thread, per benchmark
+  size_t keys = 100000;        // key space for cache benchmarks
+  size_t cache_capacity = 10000;
+  double zipf_s = 0.99;        // skew of the "skewed" distribution
+  uint64_t db_ops = 2000;      // DB round trips are ~1000x slower
+  std::string filter;          // run only benchmarks whose name contains this
+  std::string out;             // JSON output file (default: stdout)
+};
+
+// ============================================================================
+// Harness
+// ============================================================================
+struct BenchResult {
+  std::string name;
+  int threads = 1;
+  uint64_t ops = 0;
+  double ns_per_op = 0;        // per-thread average
+  double ops_per_sec = 0;      // aggregate
+  double allocs_per_op = 0;
+  double p50_ns = 0, p90_ns = 0, p99_ns = 0, p999_ns = 0;
+  bool skipped = false;
+  std::string note;
+};
+
+// Latency of every SAMPLE_EVERY-th op is recorded, so timer overhead stays
+// out of the throughput numbers for nanosecond-scale operations.
+static constexpr uint64_t SAMPLE_EVERY = 16;
+
+using OpFn = std::function<void(int thread_id, uint64_t i)>;
+
+// Escape sink for a benchmarked result: the compiler must assume the value
+// is read, so the work producing it can't be optimized away.
+template <typename T>
+static inline void do_not_optimize(T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static double percentile(const std::vector<uint64_t>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t idx = static_cast<size_t>(std::ceil(p * sorted.size())) - 1;
+  return static_cast<double>(sorted[std::min(idx, sorted.size() - 1)]);
+}
+
+static BenchResult run_bench(const std::string& name, int threads, uint64_t ops_per_thread,
+                             const OpFn& op) {
+  std::vector<std::vector<uint64_t>> samples(threads);
+  std::vector<uint64_t> allocs(threads, 0);
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+
+  auto worker = [&](int t) {
+    auto& lat = samples[t];
+    lat.reserve(ops_per_thread / SAMPLE_EVERY + 1);
+    ready++;
+    while (!go.load(std::memory_order_acquire)) {}
+
+    uint64_t a0 = t_allocs;
+    for (uint64_t i = 0; i < ops_per_thread; ++i) {
+      if (i % SAMPLE_EVERY == 0) {
+        auto s = std::chrono::steady_clock::now();
+        op(t, i);
+        auto e = std::chrono::steady_clock::now();
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(e - s).count());
+      } else {
+        op(t, i);
+      }
+    }
+    // The sample vector never grows past its reservation, so this only
+    // counts allocations made by op()
+    allocs[t] = t_allocs - a0;
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) pool.emplace_back(worker, t);
+  while (ready.load() < threads) std::this_thread::yield();
+
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : pool) th.join();
+  auto end = std::chrono::steady_clock::now();
+
+  double elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  uint64_t total = ops_per_thread * threads;
+
+  std::vector<uint64_t> all;
+  uint64_t total_allocs = 0;
+  for (int t = 0; t < threads; ++t) {
+    all.insert(all.end(), samples[t].begin(), samples[t].end());
+    total_allocs += allocs[t];
+  }
+  std::sort(all.begin(), all.end());
+
+  BenchResult r;
+  r.name = name;
+  r.threads = threads;
+  r.ops = total;
+  r.ns_per_op = elapsed_ns * threads / total;
+  r.ops_per_sec = total / (elapsed_ns / 1e9);
+  r.allocs_per_op = static_cast<double>(total_allocs) / total;
+  r.p50_ns = percentile(all, 0.50);
+  r.p90_ns = percentile(all, 0.90);
+  r.p99_ns = percentile(all, 0.99);
+  r.p999_ns = percentile(all, 0.999);
+
+  std::cerr << std::left << std::setw(36) << name << " threads=" << std::setw(3) << threads
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << r.ns_per_op << " ns/op "
+            << std::setw(12) << std::setprecision(0) << r.ops_per_sec << " ops/s "
+            << std::setprecision(2) << r.allocs_per_op << " allocs/op\n";
+  return r;
+}
+
+// ============================================================================
+// Key distributions
+// ============================================================================
+// Key index sequences are generated up front so RNG cost isn't measured.
+static std::vector<uint32_t> uniform_keys(size_t n, size_t key_space, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<uint32_t> dist(0, static_cast<uint32_t>(key_space - 1));
+  std::vector<uint32_t> out(n);
+  for (auto& k : out) k = dist(gen);
+  return out;
+}
+
+static std::vector<uint32_t> zipf_keys(size_t n, size_t key_space, double s, uint32_t seed) {
+  std::vector<double> cdf(key_space);
+  double sum = 0;
+  for (size_t i = 0; i < key_space; ++i) {
+    sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+    cdf[i] = sum;
+  }
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dist(0.0, sum);
+  std::vector<uint32_t> out(n);
+  for (auto& k : out) {
+    k = static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), dist(gen)) - cdf.begin());
+  }
+  return out;
+}
+
+// ============================================================================
+// Benchmarks
+// ============================================================================
+static std::vector<int> thread_counts(int max_threads) {
+  std::vector<int> out;
+  for (int t = 1; t < max_threads; t *= 2) out.push_back(t);
+  out.push_back(max_threads);
+  return out;
+}
+
+static bool selected(const BenchConfig& cfg, const std::string& name) {
+  return cfg.filter.empty() || name.find(cfg.filter) != std::string::npos;
+}
+
+static void bench_cache(const BenchConfig& cfg, std::vector<BenchResult>& results) {
+  std::vector<std::string> names(cfg.keys);
+  for (size_t i = 0; i < cfg.keys; ++i) names[i] = "bench_key_" + std::to_string(i);
+  const std::string value(64, 'v');
+
+  for (const char* dist : {"uniform", "skewed"}) {
+    for (int threads : thread_counts(cfg.max_threads)) {
+      std::vector<std::vector<uint32_t>> seq(threads);
+      for (int t = 0; t < threads; ++t) {
+        seq[t] = std::string(dist) == "uniform"
+          ? uniform_keys(cfg.ops, cfg.keys, 1000 + t)
+          : zipf_keys(cfg.ops, cfg.keys, cfg.zipf_s, 1000 + t);
+      }
+
+      auto key_at = [&](int t, uint64_t i) -> const std::string& { return names[seq[t][i]]; };
+
+      // Warm cache so get() measures a realistic hit/miss mix
+      auto warm = [&](LRUCache& cache) {
+        for (size_t i = 0; i < cfg.cache_capacity && i < cfg.keys; ++i) cache.put(names[i], value);
+      };
+
+      std::string suffix = std::string("/") + dist;
+      if (selected(cfg, "lru_get" + suffix)) {
+        LRUCache cache(cfg.cache_capacity);
+        warm(cache);
+        results.push_back(run_bench("lru_get" + suffix, threads, cfg.ops,
+          [&](int t, uint64_t i) { auto v = cache.get(key_at(t, i)); do_not_optimize(v); }));
+      }
+      if (selected(cfg, "lru_put" + suffix)) {
+        LRUCache cache(cfg.cache_capacity);
+        warm(cache);
+        results.push_back(run_bench("lru_put" + suffix, threads, cfg.ops,
+          [&](int t, uint64_t i) { cache.put(key_at(t, i), value); }));
+      }
+      if (selected(cfg, "lru_erase" + suffix)) {
+        LRUCache cache(cfg.cache_capacity);
+        warm(cache);
+        results.push_back(run_bench("lru_erase" + suffix, threads, cfg.ops,
+          [&](int t, uint64_t i) { cache.erase(key_at(t, i)); }));
+      }
+      if (selected(cfg, "lru_mixed" + suffix)) {
+        // 90% get / 9% put / 1% erase
+        LRUCache cache(cfg.cache_capacity);
+        warm(cache);
+        results.push_back(run_bench("lru_mixed" + suffix, threads, cfg.ops,
+          [&](int t, uint64_t i) {
+            const std::string& k = key_at(t, i);
+            uint64_t r = i % 100;
+            if (r < 90) { auto v = cache.get(k); do_not_optimize(v); }
+            else if (r < 99) cache.put(k, value);
+            else cache.erase(k);
+          }));
+      }
+    }
+  }
+}
+
+static void bench_http(const BenchConfig& cfg, std::vector<BenchResult>& results) {
+  const std::string body =
+    "{\"key\":\"popular_key_42\",\"value\":\"popular_value_42_with_some_padding\"}";
+  const std::string query = "key=popular_key_42";
+  const std::string value = "popular_value_42_with_some_padding";
+
+  if (selected(cfg, "parse_create_body")) {
+    results.push_back(run_bench("parse_create_body", 1, cfg.ops, [&](int, uint64_t) {
+      auto kv = util::parse_json_kv(body);
+      do_not_optimize(kv);
+    }));
+  }
+  if (selected(cfg, "parse_read_query")) {
+    results.push_back(run_bench("parse_read_query", 1, cfg.ops, [&](int, uint64_t) {
+      httplib::Params params;
+      httplib::detail::parse_query_text(query, params);
+      do_not_optimize(params);
+    }));
+  }
+  if (selected(cfg, "build_read_response")) {
+    results.push_back(run_bench("build_read_response", 1, cfg.ops, [&](int, uint64_t) {
+      httplib::Response res;
+      util::ok(res, util::json_kv("value", value));
+      do_not_optimize(res);
+    }));
+  }
+}
+
+static void bench_db(const BenchConfig& cfg, std::vector<BenchResult>& results) {
+  if (!selected(cfg, "db_upsert") && !selected(cfg, "db_get") && !selected(cfg, "db_erase")) return;
+
+  DB db;
+  if (!db.connect(DBConfig{})) {
+    for (const char* name : {"db_upsert", "db_get", "db_erase"}) {
+      if (!selected(cfg, name)) continue;
+      BenchResult r;
+      r.name = name;
+      r.skipped = true;
+      r.note = "no database";
+      results.push_back(r);
+    }
+    std::cerr << "DB benchmarks skipped: no database\n";
+    return;
+  }
+
+  auto key = [](uint64_t i) { return "kvbench_" + std::to_string(i); };
+  const std::string value(64, 'v');
+
+  // Single connection, single thread: the server uses one connection per
+  // pool thread, so this is the per-thread cost of each operation.
+  if (selected(cfg, "db_upsert")) {
+    results.push_back(run_bench("db_upsert", 1, cfg.db_ops, [&](int, uint64_t i) {
+      db.upsert(key(i), value);
+    }));
+  }
+  if (selected(cfg, "db_get")) {
+    results.push_back(run_bench("db_get", 1, cfg.db_ops, [&](int, uint64_t i) {
+      auto v = db.get(key(i));
+      do_not_optimize(v);
+    }));
+  }
+  if (selected(cfg, "db_erase")) {
+    results.push_back(run_bench("db_erase", 1, cfg.db_ops, [&](int, uint64_t i) {
+      db.erase(key(i));
+    }));
+  }
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+static void write_json(std::ostream& os, const BenchConfig& cfg,
+                       const std::vector<BenchResult>& results) {
+  os << "{\n  \"config\": {\"max_threads\": " << cfg.max_threads
+     << ", \"ops_per_thread\": " << cfg.ops
+     << ", \"keys\": " << cfg.keys
+     << ", \"cache_capacity\": " << cfg.cache_capacity
+     << ", \"zipf_s\": " << cfg.zipf_s
+     << ", \"db_ops\": " << cfg.db_ops << "},\n";
+  os << "  \"results\": [\n";
+  os << std::fixed << std::setprecision(2);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    os << "    {\"name\": \"" << r.name << "\", \"threads\": " << r.threads;
+    if (r.skipped) {
+      os << ", \"skipped\": true, \"reason\": \"" << r.note << "\"}";
+    } else {
+      os << ", \"ops\": " << r.ops
+         << ", \"ns_per_op\": " << r.ns_per_op
+         << ", \"ops_per_sec\": " << r.ops_per_sec
+         << ", \"allocs_per_op\": " << r.allocs_per_op
+         << ", \"p50_ns\": " << r.p50_ns
+         << ", \"p90_ns\": " << r.p90_ns
+         << ", \"p99_ns\": " << r.p99_ns
+         << ", \"p999_ns\": " << r.p999_ns << "}";
+    }
+    os << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "  ]\n}\n";
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+int main(int argc, char* argv[]) {
+  BenchConfig cfg;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      cfg.max_threads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--ops" && i + 1 < argc) {
+      cfg.ops = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--keys" && i + 1 < argc) {
+      cfg.keys = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--capacity" && i + 1 < argc) {
+      cfg.cache_capacity = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--zipf" && i + 1 < argc) {
+      cfg.zipf_s = std::atof(argv[++i]);
+    } else if (arg == "--db-ops" && i + 1 < argc) {
+      cfg.db_ops = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--filter" && i + 1 < argc) {
+      cfg.filter = argv[++i];
+    } else if (arg == "--out" && i + 1 < argc) {
+      cfg.out = argv[++i];
+    } else if (arg == "--help") {
+      std::cout << "Usage: " << argv[0] << " [options]\n";
+      std::cout << "Options:\n";
+      std::cout << "  --threads <n>      Max threads for cache benchmarks (default: #cores)\n";
+      std::cout << "  --ops <n>          Operations per thread per benchmark (default: 200000)\n";
+      std::cout << "  --keys <n>         Key space size (default: 100000)\n";
+      std::cout << "  --capacity <n>     LRUCache capacity (default: 10000)\n";
+      std::cout << "  --zipf <s>         Skew of the skewed key distribution (default: 0.99)\n";
+      std::cout << "  --db-ops <n>       Operations per DB benchmark (default: 2000)\n";
+      std::cout << "  --filter <substr>  Only run benchmarks whose name contains substr\n";
+      std::cout << "  --out <file>       Write JSON results to file (default: stdout)\n";
+      std::cout << "  --help             Show this help message\n";
+      return 0;
+    }
+  }
+
+  std::vector<BenchResult> results;
+  bench_cache(cfg, results);
+  bench_http(cfg, results);
+  bench_db(cfg, results);
+
+  if (cfg.out.empty()) {
+    write_json(std::cout, cfg, results);
+  } else {
+    std::ofstream f(cfg.out);
+    if (!f) {
+      std::cerr << "Cannot write " << cfg.out << "\n";
+      return 1;
+    }
+    write_json(f, cfg, results);
+    std::cerr << "Results written to " << cfg.out << "\n";
+  }
+  return 0;
+}
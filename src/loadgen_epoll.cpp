@@ -0,0 +1,422 @@
+#include "loadgen.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// ============================================================================
+// Event-driven engine
+// ============================================================================
+// Each thread owns an epoll set of nonblocking keep-alive connections. Every
+// connection runs closed-loop like a blocking client, except that it may keep
+// up to pipeline_depth requests in flight; thousands of simulated clients
+// therefore need only a handful of OS threads.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t MAX_BACKLOG = 4096;
+constexpr int MAX_TRIES = 1024;  // generated requests per next_for() call
+
+struct Target {
+  std::string host_header;
+  sockaddr_storage addr{};
+  socklen_t addr_len = 0;
+};
+
+bool resolve(const std::string& host, int port, Target& out) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res) {
+    return false;
+  }
+  std::memcpy(&out.addr, res->ai_addr, res->ai_addrlen);
+  out.addr_len = res->ai_addrlen;
+  out.host_header = host + ":" + std::to_string(port);
+  freeaddrinfo(res);
+  return true;
+}
+
+struct InFlight {
+  Clock::time_point start;
+  bool accept_404;
+};
+
+struct Conn {
+  int fd = -1;
+  size_t node = 0;
+  bool connecting = false;
+  bool want_write = false;  // EPOLLOUT currently registered
+  bool close_after = false; // server asked to close the connection
+  std::string out;          // serialized requests not yet written
+  size_t out_off = 0;
+  std::string in;           // bytes received, not yet parsed
+  std::deque<InFlight> inflight;
+};
+
+class EpollEngine {
+public:
+  EpollEngine(int thread_id, const LoadGenConfig& config, const HashRing* ring,
+              WorkloadGenerator* workload, Stats& stats)
+      : thread_id_(thread_id), config_(config), ring_(ring), workload_(workload),
+        stats_(stats), pacer_(config.target_rps / config.num_threads) {}
+
+  ~EpollEngine() {
+    for (auto& c : conns_) {
+      if (c->fd >= 0) close(c->fd);
+    }
+    if (ep_ >= 0) close(ep_);
+  }
+
+  bool init() {
+    if (ring_) {
+      for (const auto& n : ring_->nodes()) {
+        Target t;
+        if (!resolve(n.host, n.port, t)) return fail("cannot resolve " + n.host);
+        targets_.push_back(t);
+      }
+    } else {
+      Target t;
+      if (!resolve(config_.server_host, config_.server_port, t)) {
+        return fail("cannot resolve " + config_.server_host);
+      }
+      targets_.push_back(t);
+    }
+    backlog_.resize(targets_.size());
+
+    ep_ = epoll_create1(0);
+    if (ep_ < 0) return fail("epoll_create1 failed");
+
+    // Spread connections over nodes; every node gets at least one
+    int n = std::max<int>(config_.conns_per_thread, static_cast<int>(targets_.size()));
+    for (int i = 0; i < n; ++i) {
+      auto c = std::make_unique<Conn>();
+      c->node = i % targets_.size();
+      conns_.push_back(std::move(c));
+    }
+    for (auto& c : conns_) open_conn(*c);
+    return true;
+  }
+
+  void run(std::atomic<bool>& should_stop) {
+    std::vector<epoll_event> events(256);
+    auto last_retry = Clock::now();
+
+    while (!should_stop.load()) {
+      // Paced runs wake every millisecond to release the next due sends
+      int n = epoll_wait(ep_, events.data(), static_cast<int>(events.size()),
+                         pacer_.enabled() ? 1 : 100);
+      if (n < 0 && errno != EINTR) break;
+
+      for (int i = 0; i < n; ++i) {
+        Conn& c = *static_cast<Conn*>(events[i].data.ptr);
+        if (c.fd < 0) continue;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          drop(c);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT) on_writable(c);
+        if (c.fd >= 0 && (events[i].events & EPOLLIN)) on_readable(c);
+      }
+
+      if (pacer_.enabled()) {
+        for (auto& c : conns_) {
+          if (!pacer_.ready(Clock::now())) break;
+          if (c->fd >= 0 && !c->connecting) fill(*c);
+        }
+      }
+
+      // Reopen dropped connections at most every 100 ms so a dead server
+      // doesn't turn into a reconnect spin
+      auto now = Clock::now();
+      if (now - last_retry >= std::chrono::milliseconds(100)) {
+        last_retry = now;
+        for (auto& c : conns_) {
+          if (c->fd < 0) {
+            open_conn(*c);
+          } else if (!c->connecting && c->inflight.empty()) {
+            fill(*c);  // idle after next_for() gave up
+          }
+        }
+      }
+    }
+  }
+
+private:
+  bool fail(const std::string& msg) {
+    std::cerr << "Thread " << thread_id_ << ": " << msg << "\n";
+    return false;
+  }
+
+  void open_conn(Conn& c) {
+    const Target& t = targets_[c.node];
+    c.fd = socket(t.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd < 0) return;
+
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int rc = connect(c.fd, reinterpret_cast<const sockaddr*>(&t.addr), t.addr_len);
+    if (rc < 0 && errno != EINPROGRESS) {
+      close(c.fd);
+      c.fd = -1;
+      return;
+    }
+
+    c.connecting = rc < 0;
+    c.close_after = false;
+    c.out.clear();
+    c.out_off = 0;
+    c.in.clear();
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = &c;
+    c.want_write = true;
+    epoll_ctl(ep_, EPOLL_CTL_ADD, c.fd, &ev);
+
+    if (!c.connecting) fill(c);
+  }
+
+  // Everything in flight on a broken connection counts as failed
+  void drop(Conn& c) {
+    for (size_t i = 0; i < c.inflight.size(); ++i) stats_.record_failure();
+    c.inflight.clear();
+    epoll_ctl(ep_, EPOLL_CTL_DEL, c.fd, nullptr);
+    close(c.fd);
+    c.fd = -1;
+  }
+
+  // Graceful close by the server (keep-alive limit): reconnect right away
+  void recycle(Conn& c) {
+    drop(c);
+    open_conn(c);
+  }
+
+  void set_write_interest(Conn& c, bool on) {
+    if (c.want_write == on) return;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    if (on) ev.events |= EPOLLOUT;
+    ev.data.ptr = &c;
+    epoll_ctl(ep_, EPOLL_CTL_MOD, c.fd, &ev);
+    c.want_write = on;
+  }
+
+  // Next request for this connection's node. Requests generated for other
+  // nodes wait in that node's backlog for one of its connections. nullopt
+  // when MAX_TRIES requests in a row belonged elsewhere (a node may own
+  // none of the workload's keys); the connection then idles until the
+  // periodic sweep in run() finds work for it.
+  std::optional<KVRequest> next_for(size_t node) {
+    if (!backlog_[node].empty()) {
+      KVRequest r = std::move(backlog_[node].front());
+      backlog_[node].pop_front();
+      return r;
+    }
+    for (int i = 0; i < MAX_TRIES; ++i) {
+      KVRequest r = workload_->next(thread_id_);
+      size_t owner = ring_ ? ring_->owner_index(r.key) : 0;
+      if (owner == node) return r;
+      // A node whose connections are all down must not grow memory forever
+      if (backlog_[owner].size() < MAX_BACKLOG) backlog_[owner].push_back(std::move(r));
+    }
+    return std::nullopt;
+  }
+
+  void serialize(Conn& c, const KVRequest& r) {
+    static const char* methods[] = {"GET", "POST", "DELETE"};
+    std::string& o = c.out;
+    o += methods[static_cast<int>(r.method)];
+    o += ' ';
+    o += r.path;
+    o += " HTTP/1.1\r\nHost: ";
+    o += targets_[c.node].host_header;
+    o += "\r\n";
+    if (config_.deadline_ms > 0) {
+      auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+      o += "X-Deadline-Ms: " + std::to_string(now_ms + config_.deadline_ms) + "\r\n";
+    }
+    if (r.method == KVRequest::Method::Post) {
+      o += "Content-Type: application/json\r\nContent-Length: ";
+      o += std::to_string(r.body.size());
+      o += "\r\n\r\n";
+      o += r.body;
+    } else {
+      o += "\r\n";
+    }
+  }
+
+  // Tops the connection up to pipeline_depth requests in flight
+  void fill(Conn& c) {
+    if (c.close_after) return;
+    int depth = std::max(1, config_.pipeline_depth);
+    while (static_cast<int>(c.inflight.size()) < depth) {
+      auto now = Clock::now();
+      if (!pacer_.ready(now)) break;
+      auto r = next_for(c.node);
+      if (!r) break;
+      pacer_.sent(now);
+      serialize(c, *r);
+      c.inflight.push_back({now, r->accept_404});
+    }
+    flush(c);
+  }
+
+  void flush(Conn& c) {
+    while (c.out_off < c.out.size()) {
+      ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+      if (n > 0) {
+        c.out_off += n;
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        set_write_interest(c, true);
+        return;
+      } else {
+        drop(c);
+        return;
+      }
+    }
+    c.out.clear();
+    c.out_off = 0;
+    set_write_interest(c, false);
+  }
+
+  void on_writable(Conn& c) {
+    if (c.connecting) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        drop(c);
+        return;
+      }
+      c.connecting = false;
+      fill(c);
+      return;
+    }
+    flush(c);
+  }
+
+  void on_readable(Conn& c) {
+    char buf[16384];
+    while (true) {
+      ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        c.in.append(buf, n);
+        continue;
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        parse(c);
+        if (c.fd < 0) return;
+        if (n == 0 && c.inflight.empty()) recycle(c);
+        else drop(c);
+        return;
+      }
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    parse(c);
+    if (c.fd < 0) return;
+    if (c.close_after && c.inflight.empty()) {
+      recycle(c);
+      return;
+    }
+    fill(c);
+  }
+
+  // Consumes complete responses from c.in, oldest request first
+  void parse(Conn& c) {
+    size_t pos = 0;
+    while (!c.inflight.empty()) {
+      size_t hdr_end = c.in.find("\r\n\r\n", pos);
+      if (hdr_end == std::string::npos) break;
+
+      // "HTTP/1.1 200 OK"
+      int status = 0;
+      size_t sp = c.in.find(' ', pos);
+      if (sp != std::string::npos && sp < hdr_end) status = std::atoi(c.in.c_str() + sp + 1);
+
+      size_t content_length = 0;
+      bool chunked = false;
+      size_t line = c.in.find("\r\n", pos) + 2;
+      while (line < hdr_end) {
+        size_t eol = c.in.find("\r\n", line);
+        size_t colon = c.in.find(':', line);
+        if (colon != std::string::npos && colon < eol) {
+          std::string name = c.in.substr(line, colon - line);
+          for (auto& ch : name) ch = static_cast<char>(std::tolower(ch));
+          size_t vstart = c.in.find_first_not_of(' ', colon + 1);
+          std::string value = c.in.substr(vstart, eol - vstart);
+          if (name == "content-length") content_length = std::strtoull(value.c_str(), nullptr, 10);
+          else if (name == "connection" && value.find("close") != std::string::npos) c.close_after = true;
+          else if (name == "transfer-encoding") chunked = true;
+        }
+        line = eol + 2;
+      }
+
+      if (chunked) {
+        // The KV server never chunks these responses; don't guess
+        drop(c);
+        return;
+      }
+
+      size_t body_start = hdr_end + 4;
+      if (c.in.size() < body_start + content_length) break;
+      pos = body_start + content_length;
+
+      InFlight f = c.inflight.front();
+      c.inflight.pop_front();
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - f.start).count();
+      stats_.record_status(status, f.accept_404, us);
+    }
+    c.in.erase(0, pos);
+  }
+
+  int thread_id_;
+  const LoadGenConfig& config_;
+  const HashRing* ring_;
+  WorkloadGenerator* workload_;
+  Stats& stats_;
+  Pacer pacer_;
+
+  int ep_ = -1;
+  std::vector<Target> targets_;
+  std::vector<std::unique_ptr<Conn>> conns_;
+  std::vector<std::deque<KVRequest>> backlog_;  // per node
+};
+
+} // namespace
+
+void epoll_worker_thread(int thread_id, const LoadGenConfig& config, const HashRing* ring,
+                         WorkloadGenerator* workload, Stats& stats,
+                         std::atomic<bool>& should_stop) {
+  EpollEngine engine(thread_id, config, ring, workload, stats);
+  if (!engine.init()) return;
+
+  if (config.verbose) {
+    std::cout << "Thread " << thread_id << " started (" << config.conns_per_thread
+              << " connections, pipeline depth " << config.pipeline_depth << ")\n";
+  }
+  engine.run(should_stop);
+  if (config.verbose) std::cout << "Thread " << thread_id << " stopped\n";
+}
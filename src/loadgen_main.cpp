@@ -1,4 +1,6 @@
 #include "cpp-httplib/httplib.h"
+#include "hash_ring.hpp"
+#include "loadgen.hpp"
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -10,124 +12,102 @@
 #include <cstdlib>
 #include <string>
 #include <sstream>
+#include <memory>
 
 // ============================================================================
-// Configuration
+// Routing (blocking engine)
 // ============================================================================
-struct LoadGenConfig {
-  std::string server_host = "127.0.0.1";
-  int server_port = 8080;
-  int num_threads = 10;
-  int duration_seconds = 60;
-  std::string workload_type = "get_popular"; // get_all, put_all, get_popular, get_put
-  int popular_keys = 100; // for get_popular workload
-  double read_ratio = 0.8; // for get_put workload (80% reads, 20% writes)
-};
-
-// ============================================================================
-// Statistics tracking
-// ============================================================================
-struct Stats {
-  std::atomic<uint64_t> total_requests{0};
-  std::atomic<uint64_t> successful_requests{0};
-  std::atomic<uint64_t> failed_requests{0};
-  std::atomic<uint64_t> total_response_time_us{0};
-  
-  void record_success(uint64_t response_time_us) {
-    total_requests++;
-    successful_requests++;
-    total_response_time_us += response_time_us;
+class Router {
+public:
+  Router(const LoadGenConfig& config, const HashRing* ring) : ring_(ring) {
+    if (ring_) {
+      for (const auto& n : ring_->nodes()) clients_.push_back(make_client(n.host, n.port));
+    } else {
+      clients_.push_back(make_client(config.server_host, config.server_port));
+    }
   }
-  
-  void record_failure() {
-    total_requests++;
-    failed_requests++;
+
+  // Talks directly to the node that owns the key
+  httplib::Client& for_key(const std::string& key) {
+    if (!ring_) return *clients_[0];
+    return *clients_[ring_->owner_index(key)];
   }
-  
-  void print_summary(int duration_seconds) {
-    uint64_t total = total_requests.load();
-    uint64_t success = successful_requests.load();
-    uint64_t failed = failed_requests.load();
-    uint64_t total_time = total_response_time_us.load();
-    
-    double throughput = static_cast<double>(success) / duration_seconds;
-    double avg_response_time_ms = success > 0 ? 
-      static_cast<double>(total_time) / success / 1000.0 : 0.0;
-    
-    std::cout << "\n========================================\n";
-    std::cout << "LOAD TEST RESULTS\n";
-    std::cout << "========================================\n";
-    std::cout << "Duration:              " << duration_seconds << " seconds\n";
-    std::cout << "Total requests:        " << total << "\n";
-    std::cout << "Successful requests:   " << success << "\n";
-    std::cout << "Failed requests:       " << failed << "\n";
-    std::cout << "Success rate:          " << std::fixed << std::setprecision(2) 
-              << (total > 0 ? (success * 100.0 / total) : 0.0) << "%\n";
-    std::cout << "========================================\n";
-    std::cout << "Average Throughput:    " << std::fixed << std::setprecision(2) 
-              << throughput << " req/s\n";
-    std::cout << "Average Response Time: " << std::fixed << std::setprecision(2) 
-              << avg_response_time_ms << " ms\n";
-    std::cout << "========================================\n";
+
+private:
+  static std::unique_ptr<httplib::Client> make_client(const std::string& host, int port) {
+    auto client = std::make_unique<httplib::Client>(host, port);
+    client->set_connection_timeout(5, 0);
+    client->set_read_timeout(10, 0);
+    client->set_write_timeout(10, 0);
+    return client;
   }
+
+  const HashRing* ring_;
+  std::vector<std::unique_ptr<httplib::Client>> clients_;
 };
 
+void execute_request(Router& router, const KVRequest& r, Stats& stats, int deadline_ms) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  try {
+    httplib::Client& client = router.for_key(r.key);
+    httplib::Headers headers;
+    if (deadline_ms > 0) {
+      auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+      headers.emplace("X-Deadline-Ms", std::to_string(now_ms + deadline_ms));
+    }
+
+    httplib::Result res;
+    switch (r.method) {
+      case KVRequest::Method::Get:    res = client.Get(r.path, headers); break;
+      case KVRequest::Method::Post:   res = client.Post(r.path, headers, r.body, "application/json"); break;
+      case KVRequest::Method::Delete: res = client.Delete(r.path, headers); break;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    if (res) {
+      stats.record_status(res->status, r.accept_404, duration);
+    } else {
+      stats.record_failure();
+    }
+  } catch (...) {
+    stats.record_failure();
+  }
+}
+
 // ============================================================================
 // Workload generators
 // ============================================================================
-class WorkloadGenerator {
-public:
-  virtual ~WorkloadGenerator() = default;
-  virtual void execute(httplib::Client& client, Stats& stats, int thread_id) = 0;
-};
-
 // PUT ALL: Only create/delete requests (disk-bound at DB)
 class PutAllWorkload : public WorkloadGenerator {
 private:
   std::atomic<uint64_t> counter_{0};
   
 public:
-  void execute(httplib::Client& client, Stats& stats, int thread_id) override {
+  KVRequest next(int thread_id) override {
     std::random_device rd;
     std::mt19937 gen(rd() + thread_id);
     std::uniform_int_distribution<> op_dist(0, 1);
     
     uint64_t key_num = counter_++;
-    std::string key = "key_" + std::to_string(thread_id) + "_" + std::to_string(key_num);
+    KVRequest r;
+    r.key = "key_" + std::to_string(thread_id) + "_" + std::to_string(key_num);
     
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    try {
-      if (op_dist(gen) == 0) {
-        // CREATE
-        std::string body = "{\"key\":\"" + key + "\",\"value\":\"value_" + std::to_string(key_num) + "\"}";
-        auto res = client.Post("/create", body, "application/json");
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        
-        if (res && res->status == 200) {
-          stats.record_success(duration);
-        } else {
-          stats.record_failure();
-        }
-      } else {
-        // DELETE
-        std::string path = "/delete?key=" + key;
-        auto res = client.Delete(path.c_str());
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        
-        if (res && (res->status == 200 || res->status == 404)) {
-          stats.record_success(duration);
-        } else {
-          stats.record_failure();
-        }
-      }
-    } catch (...) {
-      stats.record_failure();
+    if (op_dist(gen) == 0) {
+      // CREATE
+      r.method = KVRequest::Method::Post;
+      r.path = "/create";
+      r.body = "{\"key\":\"" + r.key + "\",\"value\":\"value_" + std::to_string(key_num) + "\"}";
+    } else {
+      // DELETE
+      r.method = KVRequest::Method::Delete;
+      r.path = "/delete?key=" + r.key;
+      r.accept_404 = true;
     }
+    return r;
   }
 };
 
@@ -137,27 +117,13 @@ private:
   std::atomic<uint64_t> counter_{0};
   
 public:
-  void execute(httplib::Client& client, Stats& stats, int thread_id) override {
+  KVRequest next(int thread_id) override {
     uint64_t key_num = counter_++;
-    std::string key = "unique_key_" + std::to_string(thread_id) + "_" + std::to_string(key_num);
-    std::string path = "/read?key=" + key;
-    
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    try {
-      auto res = client.Get(path.c_str());
-      
-      auto end = std::chrono::high_resolution_clock::now();
-      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-      
-      if (res && (res->status == 200 || res->status == 404)) {
-        stats.record_success(duration);
-      } else {
-        stats.record_failure();
-      }
-    } catch (...) {
-      stats.record_failure();
-    }
+    KVRequest r;
+    r.key = "unique_key_" + std::to_string(thread_id) + "_" + std::to_string(key_num);
+    r.path = "/read?key=" + r.key;
+    r.accept_404 = true;
+    return r;
   }
 };
 
@@ -169,31 +135,17 @@ private:
 public:
   explicit GetPopularWorkload(int popular_keys) : popular_keys_(popular_keys) {}
   
-  void execute(httplib::Client& client, Stats& stats, int thread_id) override {
+  KVRequest next(int thread_id) override {
     std::random_device rd;
     std::mt19937 gen(rd() + thread_id);
     std::uniform_int_distribution<> key_dist(0, popular_keys_ - 1);
     
     int key_num = key_dist(gen);
-    std::string key = "popular_key_" + std::to_string(key_num);
-    std::string path = "/read?key=" + key;
-    
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    try {
-      auto res = client.Get(path.c_str());
-      
-      auto end = std::chrono::high_resolution_clock::now();
-      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-      
-      if (res && (res->status == 200 || res->status == 404)) {
-        stats.record_success(duration);
-      } else {
-        stats.record_failure();
-      }
-    } catch (...) {
-      stats.record_failure();
-    }
+    KVRequest r;
+    r.key = "popular_key_" + std::to_string(key_num);
+    r.path = "/read?key=" + r.key;
+    r.accept_404 = true;
+    return r;
   }
 };
 
@@ -206,74 +158,78 @@ private:
 public:
   explicit GetPutWorkload(double read_ratio) : read_ratio_(read_ratio) {}
   
-  void execute(httplib::Client& client, Stats& stats, int thread_id) override {
+  KVRequest next(int thread_id) override {
     std::random_device rd;
     std::mt19937 gen(rd() + thread_id);
     std::uniform_real_distribution<> op_dist(0.0, 1.0);
     std::uniform_int_distribution<> key_dist(0, 9999);
     
-    auto start = std::chrono::high_resolution_clock::now();
-    
-    try {
-      if (op_dist(gen) < read_ratio_) {
-        // READ
-        int key_num = key_dist(gen);
-        std::string key = "mixed_key_" + std::to_string(key_num);
-        std::string path = "/read?key=" + key;
-        
-        auto res = client.Get(path.c_str());
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        
-        if (res && (res->status == 200 || res->status == 404)) {
-          stats.record_success(duration);
-        } else {
-          stats.record_failure();
-        }
-      } else {
-        // CREATE
-        uint64_t key_num = counter_++;
-        std::string key = "mixed_key_" + std::to_string(key_num % 10000);
-        std::string body = "{\"key\":\"" + key + "\",\"value\":\"value_" + std::to_string(key_num) + "\"}";
-        
-        auto res = client.Post("/create", body, "application/json");
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        
-        if (res && res->status == 200) {
-          stats.record_success(duration);
-        } else {
-          stats.record_failure();
-        }
-      }
-    } catch (...) {
-      stats.record_failure();
+    KVRequest r;
+    if (op_dist(gen) < read_ratio_) {
+      // READ
+      int key_num = key_dist(gen);
+      r.key = "mixed_key_" + std::to_string(key_num);
+      r.path = "/read?key=" + r.key;
+      r.accept_404 = true;
+    } else {
+      // CREATE
+      uint64_t key_num = counter_++;
+      r.key = "mixed_key_" + std::to_string(key_num % 10000);
+      r.method = KVRequest::Method::Post;
+      r.path = "/create";
+      r.body = "{\"key\":\"" + r.key + "\",\"value\":\"value_" + std::to_string(key_num) + "\"}";
     }
+    return r;
   }
 };
 
 // ============================================================================
 // Worker thread function
 // ============================================================================
-void worker_thread(int thread_id, const LoadGenConfig& config, 
+void worker_thread(int thread_id, const LoadGenConfig& config, const HashRing* ring,
                    WorkloadGenerator* workload, Stats& stats,
                    std::atomic<bool>& should_stop) {
-  // Create HTTP client for this thread
-  httplib::Client client(config.server_host, config.server_port);
-  client.set_connection_timeout(5, 0);
-  client.set_read_timeout(10, 0);
-  client.set_write_timeout(10, 0);
+  // HTTP client(s) for this thread: one per cluster node in ring mode
+  Router router(config, ring);
+  Pacer pacer(config.target_rps / config.num_threads);
   
-  std::cout << "Thread " << thread_id << " started\n";
+  if (config.verbose) std::cout << "Thread " << thread_id << " started\n";
   
-  // Closed-loop: send request, wait for response, repeat
+  // Closed-loop: send request, wait for response, repeat (no sooner than
+  // the pacer allows when a target rate is set)
   while (!should_stop.load()) {
-    workload->execute(client, stats, thread_id);
+    pacer.wait();
+    if (should_stop.load()) break;
+    execute_request(router, workload->next(thread_id), stats, config.deadline_ms);
   }
   
-  std::cout << "Thread " << thread_id << " stopped\n";
+  if (config.verbose) std::cout << "Thread " << thread_id << " stopped\n";
+}
+
+std::unique_ptr<WorkloadGenerator> make_workload(const LoadGenConfig& config) {
+  if (config.workload_type == "put_all") return std::make_unique<PutAllWorkload>();
+  if (config.workload_type == "get_all") return std::make_unique<GetAllWorkload>();
+  if (config.workload_type == "get_popular") {
+    return std::make_unique<GetPopularWorkload>(config.popular_keys);
+  }
+  if (config.workload_type == "get_put") return std::make_unique<GetPutWorkload>(config.read_ratio);
+  return nullptr;
+}
+
+LoadRun::LoadRun(const LoadGenConfig& config, const HashRing* ring, WorkloadGenerator* workload,
+                 Stats& stats) {
+  auto engine = config.engine == "epoll" ? epoll_worker_thread : worker_thread;
+  for (int i = 0; i < config.num_threads; i++) {
+    threads_.emplace_back(engine, i, std::cref(config), ring, workload, std::ref(stats),
+                          std::ref(should_stop_));
+  }
+}
+
+void LoadRun::stop() {
+  should_stop_.store(true);
+  for (auto& t : threads_) {
+    if (t.joinable()) t.join();
+  }
 }
 
 // ============================================================================
@@ -317,6 +273,7 @@ void warmup(const LoadGenConfig& config) {
 // ============================================================================
 int main(int argc, char* argv[]) {
   LoadGenConfig config;
+  std::string sweep_file;
   
   // Parse command-line arguments
   for (int i = 1; i < argc; i++) {
@@ -335,6 +292,20 @@ int main(int argc, char* argv[]) {
       config.popular_keys = std::atoi(argv[++i]);
     } else if (arg == "--read-ratio" && i + 1 < argc) {
       config.read_ratio = std::atof(argv[++i]);
+    } else if (arg == "--ring" && i + 1 < argc) {
+      config.ring_file = argv[++i];
+    } else if (arg == "--deadline-ms" && i + 1 < argc) {
+      config.deadline_ms = std::atoi(argv[++i]);
+    } else if (arg == "--engine" && i + 1 < argc) {
+      config.engine = argv[++i];
+    } else if (arg == "--conns" && i + 1 < argc) {
+      config.conns_per_thread = std::atoi(argv[++i]);
+    } else if (arg == "--pipeline" && i + 1 < argc) {
+      config.pipeline_depth = std::atoi(argv[++i]);
+    } else if (arg == "--rate" && i + 1 < argc) {
+      config.target_rps = std::atof(argv[++i]);
+    } else if (arg == "--sweep" && i + 1 < argc) {
+      sweep_file = argv[++i];
     } else if (arg == "--help") {
       std::cout << "Usage: " << argv[0] << " [options]\n";
       std::cout << "Options:\n";
@@ -345,17 +316,52 @@ int main(int argc, char* argv[]) {
       std::cout << "  --workload <type>       Workload type: put_all, get_all, get_popular, get_put (default: get_popular)\n";
       std::cout << "  --popular-keys <n>      Number of popular keys for get_popular (default: 100)\n";
       std::cout << "  --read-ratio <ratio>    Read ratio for get_put workload (default: 0.8)\n";
+      std::cout << "  --ring <file>           Cluster membership file; send each key to its owning node\n";
+      std::cout << "  --deadline-ms <ms>      Per-request deadline sent as X-Deadline-Ms (default: none)\n";
+      std::cout << "  --engine <type>         blocking (one connection per thread) or epoll (default: blocking)\n";
+      std::cout << "  --conns <n>             Connections per thread for the epoll engine (default: 100)\n";
+      std::cout << "  --pipeline <n>          Requests in flight per connection, epoll engine; needs a server that supports HTTP pipelining (default: 1)\n";
+      std::cout << "  --rate <req/s>          Open-loop target rate over all threads (default: closed loop)\n";
+      std::cout << "  --sweep <file>          Run the thread/rate sweep described in file and write its results\n";
       std::cout << "  --help                  Show this help message\n";
       return 0;
     }
   }
   
+  // Cluster ring (optional): same membership file as the servers
+  std::unique_ptr<HashRing> ring;
+  if (!config.ring_file.empty()) {
+    ClusterMembership m;
+    std::string err;
+    if (!load_membership(config.ring_file, m, err)) {
+      std::cerr << "Ring: " << err << "\n";
+      return 1;
+    }
+    ring = std::make_unique<HashRing>(m);
+  }
+  
+  if (!sweep_file.empty()) return run_sweep(sweep_file, config, ring.get());
+  
   // Print configuration
   std::cout << "========================================\n";
   std::cout << "LOAD GENERATOR CONFIGURATION\n";
   std::cout << "========================================\n";
-  std::cout << "Server:         " << config.server_host << ":" << config.server_port << "\n";
+  if (ring) {
+    std::cout << "Cluster:        " << ring->nodes().size() << " nodes (ring-aware routing)\n";
+  } else {
+    std::cout << "Server:         " << config.server_host << ":" << config.server_port << "\n";
+  }
   std::cout << "Threads:        " << config.num_threads << "\n";
+  std::cout << "Engine:         " << config.engine;
+  if (config.engine == "epoll") {
+    std::cout << " (" << config.conns_per_thread << " connections/thread, pipeline depth "
+              << config.pipeline_depth << ", " << config.num_threads * config.conns_per_thread
+              << " clients)";
+  }
+  std::cout << "\n";
+  if (config.target_rps > 0) {
+    std::cout << "Target rate:    " << config.target_rps << " req/s\n";
+  }
   std::cout << "Duration:       " << config.duration_seconds << " seconds\n";
   std::cout << "Workload:       " << config.workload_type << "\n";
   if (config.workload_type == "get_popular") {
@@ -367,19 +373,15 @@ int main(int argc, char* argv[]) {
   std::cout << "========================================\n\n";
   
   // Create appropriate workload generator
-  WorkloadGenerator* workload = nullptr;
-  if (config.workload_type == "put_all") {
-    workload = new PutAllWorkload();
-  } else if (config.workload_type == "get_all") {
-    workload = new GetAllWorkload();
-  } else if (config.workload_type == "get_popular") {
-    workload = new GetPopularWorkload(config.popular_keys);
-  } else if (config.workload_type == "get_put") {
-    workload = new GetPutWorkload(config.read_ratio);
-  } else {
+  auto workload = make_workload(config);
+  if (!workload) {
     std::cerr << "Unknown workload type: " << config.workload_type << "\n";
     return 1;
   }
+  if (config.engine != "blocking" && config.engine != "epoll") {
+    std::cerr << "Unknown engine: " << config.engine << "\n";
+    return 1;
+  }
   
   // Warmup phase
   // warmup(config);
@@ -387,17 +389,9 @@ int main(int argc, char* argv[]) {
   // Statistics
   Stats stats;
   
-  // Control flag for threads
-  std::atomic<bool> should_stop{false};
-  
   // Launch worker threads
-  std::vector<std::thread> threads;
   auto test_start = std::chrono::steady_clock::now();
-  
-  for (int i = 0; i < config.num_threads; i++) {
-    threads.emplace_back(worker_thread, i, std::ref(config), 
-                        workload, std::ref(stats), std::ref(should_stop));
-  }
+  LoadRun run(config, ring.get(), workload.get(), stats);
   
   std::cout << "Load test running";
   std::cout.flush();
@@ -412,13 +406,8 @@ int main(int argc, char* argv[]) {
   }
   std::cout << "\n";
   
-  // Stop all threads
-  should_stop.store(true);
-  
-  // Wait for all threads to finish
-  for (auto& t : threads) {
-    t.join();
-  }
+  // Stop all threads and wait for them to finish
+  run.stop();
   
   auto test_end = std::chrono::steady_clock::now();
   int actual_duration = std::chrono::duration_cast<std::chrono::seconds>(test_end - test_start).count();
@@ -426,6 +415,5 @@ int main(int argc, char* argv[]) {
   // Print results
   stats.print_summary(actual_duration);
   
-  delete workload;
   return 0;
 }
\ No newline at end of file
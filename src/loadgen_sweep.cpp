@@ -0,0 +1,558 @@
+#include "loadgen.hpp"
+#include "cpp-httplib/httplib.h"
+#include "util.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// Sweeps
+// ============================================================================
+// One sweep file describes a whole capacity run: for every workload, step
+// through the thread counts (closed loop) or target rates (open loop), each
+// step a warmup phase followed by a measurement phase. kvserver's /metrics
+// is scraped around every measurement so each step carries the server-side
+// view (cache hit ratio, DB time, server CPU) next to the client-side one,
+// and the step where throughput stops scaling is picked out per workload.
+//
+// Sweep file: one setting per line, '#' starts a comment.
+//   workloads get_popular get_put
+//   threads 1 2 4 8 16 32 64      # or: rates 1000 2000 5000 (req/s)
+//   warmup 5                      # seconds per step, not measured
+//   measure 20                    # seconds per step
+//   output sweep_results.json
+// Optional: engine, conns, pipeline, popular_keys, read_ratio, deadline_ms,
+// populate (yes/no), knee_efficiency, knee_p99_ms, max_error_rate,
+// rate_tolerance. With rates, threads may name the single thread count
+// used for every step.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct SweepConfig {
+  std::vector<std::string> workloads;
+  std::vector<int> threads;
+  std::vector<double> rates;
+  int warmup_s = 5;
+  int measure_s = 20;
+  std::string output = "sweep_results.json";
+  bool populate = true;
+
+  // Saturation: a step is past the knee when it gains less than this
+  // fraction of the relative load added (threads mode), falls short of its
+  // target rate by more than rate_tolerance (rates mode), fails more than
+  // max_error_rate of its requests, or exceeds knee_p99_ms (0 = off).
+  double knee_efficiency = 0.3;
+  double rate_tolerance = 0.05;
+  double max_error_rate = 0.01;
+  double knee_p99_ms = 0;
+};
+
+std::vector<std::string> rest_of(std::istringstream& ss) {
+  std::vector<std::string> out;
+  std::string w;
+  while (ss >> w) out.push_back(w);
+  return out;
+}
+
+bool load_sweep(const std::string& path, SweepConfig& sc, LoadGenConfig& lc, std::string& err) {
+  std::ifstream in(path);
+  if (!in) {
+    err = "cannot open " + path;
+    return false;
+  }
+
+  std::string line;
+  int lineno = 0;
+  while (std::getline(in, line)) {
+    lineno++;
+    auto hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+
+    std::istringstream ss(line);
+    std::string key;
+    if (!(ss >> key)) continue;
+    auto vals = rest_of(ss);
+    auto where = path + ":" + std::to_string(lineno) + ": ";
+    if (vals.empty()) {
+      err = where + "'" + key + "' needs a value";
+      return false;
+    }
+    const std::string& v = vals[0];
+
+    if (key == "workloads") {
+      sc.workloads = vals;
+    } else if (key == "threads") {
+      sc.threads.clear();
+      for (const auto& t : vals) sc.threads.push_back(std::atoi(t.c_str()));
+    } else if (key == "rates") {
+      sc.rates.clear();
+      for (const auto& r : vals) sc.rates.push_back(std::atof(r.c_str()));
+    } else if (key == "warmup") {
+      sc.warmup_s = std::atoi(v.c_str());
+    } else if (key == "measure") {
+      sc.measure_s = std::atoi(v.c_str());
+    } else if (key == "output") {
+      sc.output = v;
+    } else if (key == "populate") {
+      sc.populate = v == "yes" || v == "true" || v == "1";
+    } else if (key == "knee_efficiency") {
+      sc.knee_efficiency = std::atof(v.c_str());
+    } else if (key == "rate_tolerance") {
+      sc.rate_tolerance = std::atof(v.c_str());
+    } else if (key == "max_error_rate") {
+      sc.max_error_rate = std::atof(v.c_str());
+    } else if (key == "knee_p99_ms") {
+      sc.knee_p99_ms = std::atof(v.c_str());
+    } else if (key == "engine") {
+      lc.engine = v;
+    } else if (key == "conns") {
+      lc.conns_per_thread = std::atoi(v.c_str());
+    } else if (key == "pipeline") {
+      lc.pipeline_depth = std::atoi(v.c_str());
+    } else if (key == "popular_keys") {
+      lc.popular_keys = std::atoi(v.c_str());
+    } else if (key == "read_ratio") {
+      lc.read_ratio = std::atof(v.c_str());
+    } else if (key == "deadline_ms") {
+      lc.deadline_ms = std::atoi(v.c_str());
+    } else {
+      err = where + "unknown setting '" + key + "'";
+      return false;
+    }
+  }
+
+  if (sc.workloads.empty()) sc.workloads.push_back(lc.workload_type);
+  if (!sc.rates.empty()) {
+    if (sc.threads.size() > 1) {
+      err = path + ": with rates, threads takes a single thread count";
+      return false;
+    }
+    if (sc.threads.size() == 1) lc.num_threads = sc.threads[0];
+    sc.threads.clear();
+  } else if (sc.threads.empty()) {
+    err = path + ": needs threads or rates";
+    return false;
+  }
+  for (int t : sc.threads) {
+    if (t < 1) {
+      err = path + ": thread counts must be positive";
+      return false;
+    }
+  }
+  for (double r : sc.rates) {
+    if (r <= 0) {
+      err = path + ": rates must be positive";
+      return false;
+    }
+  }
+  if (sc.measure_s < 1 || sc.warmup_s < 0) {
+    err = path + ": measure must be at least 1 second, warmup not negative";
+    return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// Server metrics and CPU
+// ============================================================================
+using Metrics = std::map<std::string, double>;
+
+// /metrics is a flat object of numbers
+Metrics parse_metrics(const std::string& body) {
+  Metrics m;
+  size_t pos = 0;
+  while ((pos = body.find('"', pos)) != std::string::npos) {
+    auto end = body.find('"', pos + 1);
+    if (end == std::string::npos) break;
+    auto colon = body.find_first_not_of(" \t\r\n", end + 1);
+    if (colon == std::string::npos || body[colon] != ':') {
+      pos = end + 1;
+      continue;
+    }
+    const char* num = body.c_str() + colon + 1;
+    char* num_end = nullptr;
+    double v = std::strtod(num, &num_end);
+    if (num_end != num) m[body.substr(pos + 1, end - pos - 1)] = v;
+    pos = colon + 1;
+  }
+  return m;
+}
+
+struct Endpoint {
+  std::string host;
+  int port;
+};
+
+// Sums the metrics of every node; nullopt if any node doesn't answer
+std::optional<Metrics> scrape(const std::vector<Endpoint>& nodes) {
+  Metrics total;
+  for (const auto& n : nodes) {
+    httplib::Client client(n.host, n.port);
+    client.set_connection_timeout(2, 0);
+    client.set_read_timeout(5, 0);
+    auto res = client.Get("/metrics");
+    if (!res || res->status != 200) return std::nullopt;
+    for (const auto& [k, v] : parse_metrics(res->body)) total[k] += v;
+  }
+  return total;
+}
+
+// Whole-machine CPU counters from the first line of /proc/stat, in ticks
+struct HostCpu {
+  uint64_t busy = 0, total = 0;
+};
+
+HostCpu host_cpu() {
+  HostCpu c;
+  std::ifstream in("/proc/stat");
+  std::string cpu;
+  if (!(in >> cpu) || cpu != "cpu") return c;
+  uint64_t v;
+  for (int i = 0; i < 8 && (in >> v); ++i) {
+    c.total += v;
+    if (i != 3 && i != 4) c.busy += v;  // idle, iowait
+  }
+  return c;
+}
+
+// ============================================================================
+// Steps
+// ============================================================================
+struct StepResult {
+  std::string workload;
+  int threads = 0;
+  double target_rps = 0;  // 0 in threads mode
+  double seconds = 0;
+
+  uint64_t total = 0, ok = 0, failed = 0, shed = 0;
+  double throughput = 0;
+  double avg_ms = 0, p50_ms = 0, p90_ms = 0, p99_ms = 0, p999_ms = 0;
+
+  double loadgen_cpu = 0;  // cores
+  double host_cpu = 0;     // fraction of the machine
+
+  // Server-side deltas over the measurement; absent without /metrics
+  bool have_server = false;
+  Metrics server;
+
+  std::string saturated;  // why this step is past the knee, if it is
+};
+
+double metric(const Metrics& m, const std::string& name) {
+  auto it = m.find(name);
+  return it == m.end() ? 0 : it->second;
+}
+
+
+StepResult run_step(const LoadGenConfig& lc, const SweepConfig& sc, const HashRing* ring,
+                    const std::vector<Endpoint>& nodes, WorkloadGenerator* workload) {
+  StepResult r;
+  r.workload = lc.workload_type;
+  r.threads = lc.num_threads;
+  r.target_rps = lc.target_rps;
+
+  Stats stats;
+  LoadRun run(lc, ring, workload, stats);
+  std::this_thread::sleep_for(std::chrono::seconds(sc.warmup_s));
+
+  auto before = scrape(nodes);
+  uint64_t cpu0 = util::process_cpu_us();
+  HostCpu host0 = host_cpu();
+  stats.reset();
+  auto t0 = Clock::now();
+
+  std::this_thread::sleep_for(std::chrono::seconds(sc.measure_s));
+  run.stop();
+
+  auto t1 = Clock::now();
+  uint64_t cpu1 = util::process_cpu_us();
+  HostCpu host1 = host_cpu();
+  auto after = scrape(nodes);
+
+  r.seconds = std::chrono::duration<double>(t1 - t0).count();
+  r.total = stats.total_requests.load();
+  r.ok = stats.successful_requests.load();
+  r.failed = stats.failed_requests.load();
+  r.shed = stats.shed_requests.load();
+  r.throughput = r.ok / r.seconds;
+  r.avg_ms = r.ok ? stats.total_response_time_us.load() / 1000.0 / r.ok : 0;
+  r.p50_ms = stats.percentile_us(0.50) / 1000.0;
+  r.p90_ms = stats.percentile_us(0.90) / 1000.0;
+  r.p99_ms = stats.percentile_us(0.99) / 1000.0;
+  r.p999_ms = stats.percentile_us(0.999) / 1000.0;
+  r.loadgen_cpu = (cpu1 - cpu0) / 1e6 / r.seconds;
+  if (host1.total > host0.total) {
+    r.host_cpu = static_cast<double>(host1.busy - host0.busy) / (host1.total - host0.total);
+  }
+
+  if (before && after) {
+    r.have_server = true;
+    for (const auto& [k, v] : *after) r.server[k] = v - metric(*before, k);
+  }
+  return r;
+}
+
+// Why a step is past the knee, or "" if it isn't. prev is the previous
+// step of the same workload, if there is one.
+std::string saturation(const StepResult& s, const StepResult* prev, const SweepConfig& sc) {
+  double errors = s.total ? static_cast<double>(s.failed + s.shed) / s.total : 0;
+  if (errors > sc.max_error_rate) return "errors";
+  if (s.target_rps > 0 && s.throughput < s.target_rps * (1 - sc.rate_tolerance)) return "rate";
+  if (sc.knee_p99_ms > 0 && s.p99_ms > sc.knee_p99_ms) return "p99";
+  if (prev && s.target_rps == 0 && prev->throughput > 0 && s.threads > prev->threads) {
+    double load_gain = static_cast<double>(s.threads) / prev->threads - 1;
+    double gain = s.throughput / prev->throughput - 1;
+    if (gain / load_gain < sc.knee_efficiency) return "scaling";
+  }
+  return "";
+}
+
+// Per workload: the first saturated step and the knee just before it
+// (indexes into the steps; -1 when there is none)
+struct Knee {
+  std::string workload;
+  int knee = -1;
+  int saturated_at = -1;
+};
+
+// Finds each workload's knee from the saturation reasons already on its steps
+std::vector<Knee> find_knees(const std::vector<StepResult>& steps, const SweepConfig& sc) {
+  std::vector<Knee> knees;
+  for (const auto& w : sc.workloads) {
+    Knee k;
+    k.workload = w;
+    int prev = -1;
+    for (int i = 0; i < static_cast<int>(steps.size()); ++i) {
+      if (steps[i].workload != w) continue;
+      if (!steps[i].saturated.empty()) {
+        k.saturated_at = i;
+        k.knee = prev;
+        break;
+      }
+      prev = i;
+    }
+    knees.push_back(k);
+  }
+  return knees;
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+void json_metric(std::ostream& os, const char* name, const StepResult& s, double v) {
+  os << ", \"" << name << "\": ";
+  if (s.have_server) {
+    os << v;
+  } else {
+    os << "null";
+  }
+}
+
+void write_step(std::ostream& os, const StepResult& s) {
+  double wall_us = s.seconds * 1e6;
+  double hits = metric(s.server, "cache_hits"), misses = metric(s.server, "cache_misses");
+  double db_ops = metric(s.server, "db_ops"), db_us = metric(s.server, "db_time_us");
+
+  os << "{\"workload\": \"" << s.workload << "\", \"threads\": " << s.threads;
+  if (s.target_rps > 0) os << ", \"target_rps\": " << s.target_rps;
+  os << ", \"seconds\": " << s.seconds
+     << ", \"requests\": " << s.total
+     << ", \"ok\": " << s.ok
+     << ", \"failed\": " << s.failed
+     << ", \"shed\": " << s.shed
+     << ", \"throughput\": " << s.throughput
+     << ", \"avg_ms\": " << s.avg_ms
+     << ", \"p50_ms\": " << s.p50_ms
+     << ", \"p90_ms\": " << s.p90_ms
+     << ", \"p99_ms\": " << s.p99_ms
+     << ", \"p999_ms\": " << s.p999_ms
+     << ", \"loadgen_cpu_cores\": " << s.loadgen_cpu
+     << ", \"host_cpu_util\": " << s.host_cpu;
+  json_metric(os, "cache_hit_ratio", s, hits + misses > 0 ? hits / (hits + misses) : 0);
+  json_metric(os, "cache_hits", s, hits);
+  json_metric(os, "cache_misses", s, misses);
+  json_metric(os, "db_ops", s, db_ops);
+  json_metric(os, "db_avg_ms", s, db_ops > 0 ? db_us / db_ops / 1000.0 : 0);
+  json_metric(os, "db_busy", s, db_us / wall_us);
+  json_metric(os, "server_cpu_cores", s, metric(s.server, "process_cpu_us") / wall_us);
+  json_metric(os, "server_shed", s, metric(s.server, "admit_shed"));
+  os << ", \"saturated\": ";
+  if (s.saturated.empty()) {
+    os << "null";
+  } else {
+    os << "\"" << s.saturated << "\"";
+  }
+  os << "}";
+}
+
+void write_point(std::ostream& os, const std::vector<StepResult>& steps, int i) {
+  if (i < 0) {
+    os << "null";
+    return;
+  }
+  const StepResult& s = steps[i];
+  os << "{\"threads\": " << s.threads;
+  if (s.target_rps > 0) os << ", \"target_rps\": " << s.target_rps;
+  os << ", \"throughput\": " << s.throughput << ", \"p99_ms\": " << s.p99_ms << "}";
+}
+
+void write_results(std::ostream& os, const SweepConfig& sc, const LoadGenConfig& lc,
+                   const HashRing* ring, const std::vector<StepResult>& steps,
+                   const std::vector<Knee>& knees) {
+  os << "{\n  \"config\": {\"mode\": \"" << (sc.rates.empty() ? "threads" : "rates") << "\"";
+  if (ring) {
+    os << ", \"nodes\": " << ring->nodes().size();
+  } else {
+    os << ", \"server\": \"" << lc.server_host << ":" << lc.server_port << "\"";
+  }
+  os << ", \"engine\": \"" << lc.engine << "\"";
+  if (lc.engine == "epoll") os << ", \"conns_per_thread\": " << lc.conns_per_thread;
+  os << ", \"warmup_s\": " << sc.warmup_s
+     << ", \"measure_s\": " << sc.measure_s
+     << ", \"popular_keys\": " << lc.popular_keys
+     << ", \"read_ratio\": " << lc.read_ratio
+     << ", \"knee_efficiency\": " << sc.knee_efficiency << "},\n";
+
+  os << "  \"steps\": [\n";
+  for (size_t i = 0; i < steps.size(); ++i) {
+    os << "    ";
+    write_step(os, steps[i]);
+    os << (i + 1 < steps.size() ? ",\n" : "\n");
+  }
+  os << "  ],\n";
+
+  os << "  \"knees\": [\n";
+  for (size_t i = 0; i < knees.size(); ++i) {
+    const Knee& k = knees[i];
+    os << "    {\"workload\": \"" << k.workload << "\", \"knee\": ";
+    write_point(os, steps, k.knee);
+    os << ", \"saturated_at\": ";
+    write_point(os, steps, k.saturated_at);
+    os << ", \"reason\": ";
+    if (k.saturated_at < 0) {
+      os << "null";
+    } else {
+      os << "\"" << steps[k.saturated_at].saturated << "\"";
+    }
+    os << "}" << (i + 1 < knees.size() ? ",\n" : "\n");
+  }
+  os << "  ]\n}\n";
+}
+
+// Rewritten after every step so an interrupted sweep keeps what it measured
+bool save(const SweepConfig& sc, const LoadGenConfig& lc, const HashRing* ring,
+          const std::vector<StepResult>& steps, const std::vector<Knee>& knees) {
+  std::ofstream f(sc.output, std::ios::trunc);
+  if (!f) {
+    std::cerr << "Sweep: cannot write " << sc.output << "\n";
+    return false;
+  }
+  write_results(f, sc, lc, ring, steps, knees);
+  return static_cast<bool>(f);
+}
+
+} // namespace
+
+int run_sweep(const std::string& path, const LoadGenConfig& base, const HashRing* ring) {
+  SweepConfig sc;
+  LoadGenConfig lc = base;
+  std::string err;
+  if (!load_sweep(path, sc, lc, err)) {
+    std::cerr << "Sweep: " << err << "\n";
+    return 1;
+  }
+  if (lc.engine != "blocking" && lc.engine != "epoll") {
+    std::cerr << "Unknown engine: " << lc.engine << "\n";
+    return 1;
+  }
+  lc.verbose = false;
+
+  std::vector<Endpoint> nodes;
+  if (ring) {
+    for (const auto& n : ring->nodes()) nodes.push_back({n.host, n.port});
+  } else {
+    nodes.push_back({lc.server_host, lc.server_port});
+  }
+  if (!scrape(nodes)) {
+    std::cerr << "Sweep: /metrics unavailable; server-side columns will be null\n";
+  }
+
+  size_t levels = sc.rates.empty() ? sc.threads.size() : sc.rates.size();
+  std::cout << "Sweep: " << sc.workloads.size() << " workload(s) x " << levels << " steps, "
+            << sc.warmup_s << "s warmup + " << sc.measure_s << "s measured each, "
+            << lc.engine << " engine -> " << sc.output << "\n";
+
+  std::vector<StepResult> steps;
+  std::vector<Knee> knees;
+  bool saved = false;
+  for (const auto& w : sc.workloads) {
+    lc.workload_type = w;
+    auto workload = make_workload(lc);
+    if (!workload) {
+      std::cerr << "Unknown workload type: " << w << "\n";
+      return 1;
+    }
+    if (sc.populate) warmup(lc);
+
+    for (size_t i = 0; i < levels; ++i) {
+      if (sc.rates.empty()) {
+        lc.num_threads = sc.threads[i];
+        lc.target_rps = 0;
+      } else {
+        lc.target_rps = sc.rates[i];
+      }
+
+      steps.push_back(run_step(lc, sc, ring, nodes, workload.get()));
+      StepResult& s = steps.back();
+      s.saturated = saturation(s, i > 0 ? &steps[steps.size() - 2] : nullptr, sc);
+      double hits = metric(s.server, "cache_hits"), misses = metric(s.server, "cache_misses");
+      double db_ops = metric(s.server, "db_ops");
+      std::cout << std::fixed << std::setprecision(2) << w << " threads=" << s.threads;
+      if (s.target_rps > 0) std::cout << " rate=" << s.target_rps;
+      std::cout << ": " << s.throughput << " req/s, p50 " << s.p50_ms << " ms, p99 "
+                << s.p99_ms << " ms, errors " << (s.failed + s.shed);
+      if (s.have_server) {
+        std::cout << ", hit " << (hits + misses > 0 ? 100 * hits / (hits + misses) : 0)
+                  << "%, db " << (db_ops > 0 ? metric(s.server, "db_time_us") / db_ops / 1000 : 0)
+                  << " ms, server cpu "
+                  << metric(s.server, "process_cpu_us") / 1e6 / s.seconds;
+      }
+      std::cout << ", loadgen cpu " << s.loadgen_cpu << "\n";
+      knees = find_knees(steps, sc);
+      saved = save(sc, lc, ring, steps, knees);
+    }
+  }
+
+  if (!saved) return 1;
+  std::cout << "\nKnees (last step before throughput stops scaling):\n";
+  for (const auto& k : knees) {
+    std::cout << "  " << k.workload << ": ";
+    if (k.saturated_at < 0) {
+      std::cout << "not reached\n";
+      continue;
+    }
+    const StepResult& sat = steps[k.saturated_at];
+    if (k.knee >= 0) {
+      const StepResult& s = steps[k.knee];
+      std::cout << "threads=" << s.threads;
+      if (s.target_rps > 0) std::cout << " rate=" << s.target_rps;
+      std::cout << " (" << s.throughput << " req/s, p99 " << s.p99_ms << " ms)";
+    } else {
+      std::cout << "below the first step";
+    }
+    std::cout << "; saturated at threads=" << sat.threads;
+    if (sat.target_rps > 0) std::cout << " rate=" << sat.target_rps;
+    std::cout << " (" << sat.saturated << ")\n";
+  }
+  std::cout << "Results written to " << sc.output << "\n";
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include "refresher.hpp"
+#include <chrono>
+#include <iostream>
+
+Refresher::Refresher(LRUCache& cache, const DBConfig& dc, int workers, size_t max_queue)
+    : cache_(cache), dc_(dc), max_queue_(max_queue) {
+  if (workers < 1) workers = 1;
+  for (int i = 0; i < workers; ++i) {
+    workers_.emplace_back([this] { run(); });
+  }
+}
+
+Refresher::~Refresher() {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : workers_) t.join();
+}
+
+void Refresher::enqueue(const std::string& key, uint64_t gen) {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    if (queue_.size() < max_queue_) {
+      queue_.push_back({key, gen});
+      cv_.notify_one();
+      return;
+    }
+  }
+  dropped_++;
+  cache_.finish_refresh(key, gen, false, std::nullopt);
+}
+
+void Refresher::run() {
+  DB db;
+  bool connected = false;
+
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) return;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    if (!connected) {
+      connected = db.connect(dc_);
+      if (!connected) {
+        std::cerr << "Refresher: DB connect failed\n";
+        failed_++;
+        cache_.finish_refresh(task.key, task.gen, false, std::nullopt);
+        // Back off so a DB outage doesn't turn into a reconnect storm
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        continue;
+      }
+    }
+
+    // A missing row drops the entry. A failed query keeps serving the stale
+    // copy, and a broken connection is reopened for the next task.
+    uint64_t version = 0;
+    bool error = false;
+    auto value = db.get(task.key, &version, &error);
+    if (error) {
+      failed_++;
+      cache_.finish_refresh(task.key, task.gen, false, std::nullopt);
+      connected = db.connection_ok();
+      continue;
+    }
+    completed_++;
+    cache_.finish_refresh(task.key, task.gen, true, value, version);
+  }
+}
@@ -1,6 +1,11 @@
 #include "http_server.hpp"
+#include <csignal>
 #include <cstdlib>
 #include <iostream>
+#include <pthread.h>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 static std::string env(const char* key, const char* def) {
   const char* val = std::getenv(key);
@@ -12,6 +17,19 @@ static int env_int(const char* key, int def) {
   return val ? std::atoi(val) : def;
 }
 
+// Comma-separated integer list, e.g. "0,2,4,6"
+static std::vector<int> env_int_list(const char* key) {
+  std::vector<int> out;
+  const char* val = std::getenv(key);
+  if (!val) return out;
+  std::stringstream ss(val);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) out.push_back(std::atoi(item.c_str()));
+  }
+  return out;
+}
+
 static size_t env_size(const char* key, size_t def) {
   const char* val = std::getenv(key);
   return val ? static_cast<size_t>(std::atoll(val)) : def;
@@ -25,6 +43,37 @@ int main() {
     sc.port = env_int("SRV_PORT", 8080);
     sc.cache_capacity = env_size("CACHE_CAP", 1000);
     sc.threads = env_int("SRV_THREADS", std::thread::hardware_concurrency());
+    sc.cache_ttl_ms = env_int("CACHE_TTL_MS", 0);
+    sc.refresh_after_ms = env_int("CACHE_REFRESH_MS", 0);
+    sc.stale_window_ms = env_int("CACHE_STALE_MS", 0);
+    sc.refresh_min_hits = env_int("REFRESH_MIN_HITS", 2);
+    sc.refresh_workers = env_int("REFRESH_WORKERS", 2);
+    sc.shard_cores = env_int("SHARD_CORES", 0);
+    sc.core_cpus = env_int_list("CORE_CPUS");
+    // Shard-per-core partitions have no near-cache; only an explicit
+    // NEAR_CACHE_SLOTS is an error there
+    bool core_mode = sc.shard_cores > 0 || !sc.core_cpus.empty();
+    sc.near_cache_slots = env_int("NEAR_CACHE_SLOTS", core_mode ? 0 : 256);
+    sc.near_cache_sample = env_int("NEAR_CACHE_SAMPLE", 8);
+    sc.near_cache_threshold = env_int("NEAR_CACHE_HOT", 4);
+    sc.core_max_producers = env_int("CORE_MAX_PRODUCERS", 64);
+    sc.cluster_file = env("CLUSTER_FILE", "");
+    sc.cluster_self = env("CLUSTER_SELF", "");
+    sc.cluster_redirect = env("CLUSTER_MODE", "forward") == "redirect";
+    sc.inval_channel = env("INVAL_CHANNEL", "");
+    sc.inval_batch_ms = env_int("INVAL_BATCH_MS", 5);
+    sc.admit_db_target_ms = env_int("ADMIT_DB_TARGET_MS", 0);
+    sc.admit_db_max = env_int("ADMIT_DB_MAX", CPPHTTPLIB_THREAD_POOL_COUNT - 2);
+    sc.admit_max_queue = env_int("ADMIT_MAX_QUEUE", 0);
+    sc.retry_after_s = env_int("RETRY_AFTER_S", 1);
+    sc.snapshot_path = env("SNAPSHOT_PATH", "");
+    sc.snapshot_interval_s = env_int("SNAPSHOT_INTERVAL_S", 0);
+    sc.snapshot_load_threads = env_int("SNAPSHOT_LOAD_THREADS", 0);
+    sc.counter_flush_ms = env_int("COUNTER_FLUSH_MS", 0);
+    sc.blob_cache_cap = env_size("BLOB_CACHE_CAP", 1024);
+    sc.blob_cache_max_value = env_size("BLOB_CACHE_MAX_VALUE", 1 << 20);
+    sc.blob_compress_min = env_size("BLOB_COMPRESS_MIN", 0);
+    sc.blob_max_bytes = env_size("BLOB_MAX_BYTES", 64 << 20);
 
     // --- DB Config ---
     DBConfig dc;
@@ -34,7 +83,23 @@ int main() {
     dc.password = env("DB_PASS", "postgres123");
     dc.dbname = env("DB_NAME", "kvdb");
 
+    // SIGTERM/SIGINT shut down gracefully (so the cache snapshot gets
+    // written). Blocked here so every thread inherits the mask and one
+    // thread picks them up with sigwait().
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+
     KVServer server(sc, dc);
+    std::thread([&server, sigs] {
+      int sig;
+      if (sigwait(&sigs, &sig) == 0) {
+        std::cout << "Signal " << sig << ", shutting down\n";
+        server.stop();
+      }
+    }).detach();
     return server.start() ? 0 : 1;
   } catch (const std::exception& e) {
     std::cerr << "Fatal: " << e.what() << "\n";
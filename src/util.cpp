@@ -0,0 +1,58 @@
+#include "util.hpp"
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+namespace util {
+
+std::string json_kv(const std::string& k, const std::string& v) {
+  return std::string("{\"") + k + "\":\"" + v + "\"}";
+}
+
+std::pair<std::string, std::string> parse_json_kv(const std::string& body) {
+  auto kpos = body.find("\"key\"");
+  auto vpos = body.find("\"value\"");
+  if (kpos == std::string::npos || vpos == std::string::npos)
+    return {"", ""};
+  auto kstart = body.find('"', kpos + 5);
+  auto kend   = body.find('"', kstart + 1);
+  auto vstart = body.find('"', vpos + 7);
+  auto vend   = body.find('"', vstart + 1);
+  std::string key = body.substr(kstart + 1, kend - kstart - 1);
+  std::string val = body.substr(vstart + 1, vend - vstart - 1);
+  return {key, val};
+}
+
+std::optional<std::string> json_field(const std::string& body, const std::string& name) {
+  auto pos = body.find("\"" + name + "\"");
+  if (pos == std::string::npos) return std::nullopt;
+  pos = body.find(':', pos + name.size() + 2);
+  if (pos == std::string::npos) return std::nullopt;
+  pos = body.find_first_not_of(" \t\r\n", pos + 1);
+  if (pos == std::string::npos) return std::nullopt;
+  if (body[pos] == '"') {
+    auto end = body.find('"', pos + 1);
+    if (end == std::string::npos) return std::nullopt;
+    return body.substr(pos + 1, end - pos - 1);
+  }
+  auto end = body.find_first_of(",} \t\r\n", pos);
+  return body.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+uint64_t process_cpu_us() {
+  std::ifstream in("/proc/self/stat");
+  std::string stat;
+  if (!std::getline(in, stat)) return 0;
+  // comm (field 2) may contain spaces; utime and stime are fields 14 and 15
+  auto close = stat.rfind(')');
+  if (close == std::string::npos) return 0;
+  std::istringstream ss(stat.substr(close + 2));
+  std::string skip;
+  for (int i = 3; i < 14; ++i) ss >> skip;
+  uint64_t utime = 0, stime = 0;
+  ss >> utime >> stime;
+  static const long hz = sysconf(_SC_CLK_TCK);
+  return (utime + stime) * 1000000 / (hz > 0 ? hz : 100);
+}
+
+} // namespace util